@@ -25,7 +25,68 @@ typedef enum
 	AMP_HDLR_ERR
 }AmpHdlrErrCode;
 
+/* One TPA2016D2 per I2c bus, the address is fixed */
+typedef enum
+{
+	/* I2C2, main board */
+	AMP_HDLR_ZONE_A = 0,
+	/* I2C1, with the encoders */
+	AMP_HDLR_ZONE_B,
+	/* I2C3, expansion */
+	AMP_HDLR_ZONE_C,
+	AMP_HDLR_ZONE_NUM
+} tAmpHdlrZone;
+
+/* Zone masks of the groups */
+#define AMP_HDLR_ZONE_BIT(z) (1u << (z))
+#define AMP_HDLR_ZONE_ALL (AMP_HDLR_ZONE_BIT(AMP_HDLR_ZONE_NUM) - 1u)
+
+/* Volume knob range, the volume encoder counts 0..AMP_HDLR_VOL_POS_MAX */
+#define AMP_HDLR_VOL_POS_MAX 32u
+#define AMP_HDLR_VOL_POS_DEFAULT 12u
+
+/* Knob position to gain mapping */
+typedef enum
+{
+	AMP_HDLR_CURVE_LINEAR = 0,
+	AMP_HDLR_CURVE_LOUDNESS,
+	AMP_HDLR_CURVE_CUSTOM,
+	AMP_HDLR_CURVE_NUM
+} tAmpHdlrCurve;
+
+/* TPA2016D2 AGC settings, fields as in the register map */
+typedef struct
+{
+	/* 0x02..0x04, 6 bit each */
+	uint8_t attack;
+	uint8_t release;
+	uint8_t hold;
+	/* 0x06: limiter disable, noise gate threshold, limiter level */
+	uint8_t limiter;
+	/* 0x07: max gain, compression ratio */
+	uint8_t compression;
+	/* NG_EN in 0x01 */
+	boolean isNoiseGate;
+} tAmpHdlrAgcProfile;
+
+typedef enum
+{
+	AMP_HDLR_AGC_FLAT = 0,
+	AMP_HDLR_AGC_SPEECH,
+	AMP_HDLR_AGC_MUSIC,
+	AMP_HDLR_AGC_NIGHT,
+	AMP_HDLR_AGC_NUM
+} tAmpHdlrAgcId;
+
 AmpHdlrErrCode AmpHdlrInit(void);
 AmpHdlrErrCode AmpHdlrRun(void);
-AmpHdlrErrCode AmpHdlrSetGain (uint8_t gain);
+AmpHdlrErrCode AmpHdlrSetVolume (tAmpHdlrZone zone, uint8_t pos);
+AmpHdlrErrCode AmpHdlrSetGroup (tEncHdlrDevIdx dev, uint32_t zoneMask);
+AmpHdlrErrCode AmpHdlrSetMute (tAmpHdlrZone zone, boolean isMuted);
+AmpHdlrErrCode AmpHdlrSetCurve (tAmpHdlrCurve curve);
+AmpHdlrErrCode AmpHdlrSetAgcProfile (tAmpHdlrZone zone, const tAmpHdlrAgcProfile *profile);
+AmpHdlrErrCode AmpHdlrSelectAgcProfile (tAmpHdlrZone zone, tAmpHdlrAgcId id);
+boolean AmpHdlrIsAsleep (void);
+boolean AmpHdlrIsIdle (void);
+AmpHdlrErrCode AmpHdlrSetSlew (uint32_t msPerDb);
 #endif
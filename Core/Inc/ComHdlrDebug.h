@@ -42,6 +42,7 @@ ComDebugHdlrErrCode UartDebugHdlrRun(void);
 ComDebugHdlrErrCode UartDebugHdlrTx(uint8_t *buff, uint32_t size);
 ComDebugHdlrErrCode UartDebugHdlrRx(uint8_t *buff, uint32_t size);
 ComDebugHdlrErrCode UartDebugHdlrFlushRx(void);
+boolean UartDebugHdlrIsTxBusy(void);
 
 
 
@@ -0,0 +1,88 @@
+/**
+  ******************************************************************************
+  * @file           : DevHdlr.h
+  * @brief          : I2c device engine header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef DEV_HDLR_H
+#define DEV_HDLR_H
+
+typedef enum
+{
+	DEV_HDLR_OK = 0,
+	DEV_HDLR_BUSY,
+	DEV_HDLR_ERR
+}DevHdlrErrCode;
+
+/* Engine limits, per device */
+#define DEV_HDLR_DEV_MAX 8u
+#define DEV_HDLR_CFG_MAX 8u
+#define DEV_HDLR_READ_MAX 4u
+#define DEV_HDLR_WRITE_MAX 4u
+
+/* Called from DevHdlrRun(), dev is the index returned by DevHdlrAttach() */
+typedef void (*tDevHdlrReadCb)(uint32_t dev, const uint8_t *data, tI2cHdlrTrStatus status);
+typedef void (*tDevHdlrWriteCb)(uint32_t dev, tI2cHdlrTrStatus status);
+
+/* Read of reg..reg+length-1 every period ms, on DevHdlrReadRequest() only when period is 0 */
+typedef struct
+{
+	uint8_t reg;
+	uint8_t length;
+	uint32_t period;
+	tDevHdlrReadCb callback;
+} tDevHdlrRead;
+
+/*
+ * Write of reg..reg+length-1 from pValue whenever it differs from what was
+ * last written. After a failed batch the device gets no write before a
+ * growing delay, then the failed items go again.
+ */
+typedef struct
+{
+	uint8_t reg;
+	uint8_t length;
+	const uint8_t *pValue;
+	tDevHdlrWriteCb callback;
+} tDevHdlrWrite;
+
+/*
+ * One device, kept in flash. The init rows are loaded, again with a growing
+ * delay while they fail, then the reads and writes are served. Writes are listed in register order, the ones
+ * changed together on contiguous registers go out as one burst, unchanged
+ * writes in between included. The value pointed by a write at attach time
+ * is taken as already in the device.
+ */
+typedef struct
+{
+	const char *name;
+	tI2cHdlrModIdx i2cIdx;
+	uint8_t addr;
+	const tI2cHdlrRegCfg *init;
+	uint32_t initNum;
+	const tDevHdlrRead *reads;
+	uint32_t readNum;
+	const tDevHdlrWrite *writes;
+	uint32_t writeNum;
+	/* Optional, NULL when not used */
+	tI2cHdlrShadow *shadow;
+} tDevHdlrDesc;
+
+void DevHdlrInit(void);
+void DevHdlrRun(void);
+DevHdlrErrCode DevHdlrAttach(const tDevHdlrDesc *desc, uint32_t *pDev);
+boolean DevHdlrIsReady(uint32_t dev);
+DevHdlrErrCode DevHdlrReadRequest(uint32_t dev, uint32_t item);
+DevHdlrErrCode DevHdlrSetPeriod(uint32_t dev, uint32_t item, uint32_t period);
+#endif
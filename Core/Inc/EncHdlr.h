@@ -23,9 +23,61 @@ typedef enum
 {
 	ENC_HDLR_OK = 0,
 	ENC_HDLR_BUSY,
+	ENC_HDLR_NODATA,
 	ENC_HDLR_ERR
 }EncHdlrErrCode;
 
+/* Encoders sharing the INT line, one row each in the device table */
+typedef enum
+{
+	ENC_HDLR_DEV_VOLUME = 0,
+	ENC_HDLR_DEV_BALANCE,
+	ENC_HDLR_DEV_AGC,
+	ENC_HDLR_DEV_NUM
+} tEncHdlrDevIdx;
+
+/* ESTATUS bits */
+#define ENC_HDLR_ST_PUSHR	0x01u
+#define ENC_HDLR_ST_PUSHP	0x02u
+#define ENC_HDLR_ST_PUSHD	0x04u
+#define ENC_HDLR_ST_RINC	0x08u
+#define ENC_HDLR_ST_RDEC	0x10u
+#define ENC_HDLR_ST_RMAX	0x20u
+#define ENC_HDLR_ST_RMIN	0x40u
+#define ENC_HDLR_ST_INT2	0x80u
+
+typedef struct
+{
+	/* CYCCNT when INT fell */
+	uint32_t stamp;
+	tEncHdlrDevIdx dev;
+	uint8_t status;
+	boolean isPressed;
+	int32_t delta;
+	int32_t value;
+} tEncHdlrEvent;
+
+/* Event ring cursor, one per consumer */
+typedef struct
+{
+	uint32_t tail;
+	/* Events overwritten before this consumer got to them */
+	uint32_t lost;
+} tEncHdlrReader;
+
+/* Acceleration curve point: from this many detents per second on, each detent moves the counter by step */
+typedef struct
+{
+	uint32_t minRate;
+	uint32_t step;
+} tEncHdlrAccel;
+
 EncHdlrErrCode EncHdlrInit(void);
 EncHdlrErrCode EncHdlrRun(void);
+void EncHdlrIntIrqHandler(void);
+void EncHdlrGetLastEvent(tEncHdlrDevIdx dev, tEncHdlrEvent *event);
+EncHdlrErrCode EncHdlrSetAccelCurve(tEncHdlrDevIdx dev, const tEncHdlrAccel *curve, uint32_t length);
+EncHdlrErrCode EncHdlrSetStartValue(tEncHdlrDevIdx dev, int32_t value);
+void EncHdlrReaderInit(tEncHdlrReader *reader);
+EncHdlrErrCode EncHdlrRead(tEncHdlrReader *reader, tEncHdlrEvent *event);
 #endif
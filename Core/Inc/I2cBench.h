@@ -0,0 +1,33 @@
+/**
+  ******************************************************************************
+  * @file           : I2cBench.h
+  * @brief          : I2c backend benchmark header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef I2C_BENCH_H
+#define I2C_BENCH_H
+
+typedef enum
+{
+	I2C_BENCH_OK = 0,
+	I2C_BENCH_BUSY,
+	I2C_BENCH_ERR
+}I2cBenchErrCode;
+
+I2cBenchErrCode I2cBenchInit(void);
+I2cBenchErrCode I2cBenchRun(void);
+I2cBenchErrCode I2cBenchStart(tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t regAddr);
+I2cBenchErrCode I2cBenchStartPolled(tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t regAddr);
+boolean I2cBenchIsRunning(void);
+#endif
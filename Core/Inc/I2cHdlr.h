@@ -31,13 +31,148 @@ typedef enum
     I2C_HDLR_MOD1 = 0,
     I2C_HDLR_MOD2,
     I2C_HDLR_MOD3,
+    I2C_HDLR_MOD_NUM
 } tI2cHdlrModIdx;
 
+typedef enum
+{
+    I2C_HDLR_BACKEND_POLL = 0,
+    I2C_HDLR_BACKEND_IRQ,
+    I2C_HDLR_BACKEND_DMA,
+} tI2cHdlrBackend;
+
+typedef enum
+{
+    I2C_HDLR_SPEED_100K = 0,
+    I2C_HDLR_SPEED_400K,
+    /* Fast mode with 16/9 duty, needs PCLK1 multiple of 10 MHz for exact 400 kHz */
+    I2C_HDLR_SPEED_400K_DUTY169,
+    /* Fast mode plus timing, exact with PCLK1 multiple of 25 MHz. I2C1..3 are
+     * only rated for 400 kHz, check the devices and the rise time first */
+    I2C_HDLR_SPEED_1M,
+} tI2cHdlrSpeed;
+
+/* Per-transaction outcome */
+typedef enum
+{
+	I2C_HDLR_TR_OK = 0,
+	I2C_HDLR_TR_PENDING,
+	I2C_HDLR_TR_ADDR_NACK,
+	I2C_HDLR_TR_DATA_NACK,
+	I2C_HDLR_TR_ARB_LOST,
+	I2C_HDLR_TR_BUS_ERR,
+	/* No progress within the state timeout, the bus has been recovered */
+	I2C_HDLR_TR_TIMEOUT
+} tI2cHdlrTrStatus;
+
+/* Retries used by I2cHdlrMasterTx/Rx/WriteRead */
+#define I2C_HDLR_RETRIES_DEFAULT 2u
+/* First retry delay in Timer.c ticks, doubled on every further attempt */
+#define I2C_HDLR_RETRY_BACKOFF 1
+
+/* Latency histogram buckets, bucket n counts latencies of 2^n..2^(n+1)-1 cycles */
+#define I2C_HDLR_LAT_HIST_LEN 32u
+
+typedef struct
+{
+	uint32_t trCnt;
+	uint32_t byteCnt;
+	uint32_t nackCnt;
+	uint32_t errCnt;
+	uint32_t retryCnt;
+	/* Cycles with a transaction on the bus, and cycles observed */
+	uint64_t busyCycles;
+	uint64_t windowCycles;
+	uint32_t latencyMax;
+	uint32_t latencyHist[I2C_HDLR_LAT_HIST_LEN];
+} tI2cHdlrStats;
+
+/* Called on completion, from interrupt context unless the bus is polled */
+typedef void (*tI2cHdlrCallback)(tI2cHdlrModIdx devIdx, uint32_t token, tI2cHdlrTrStatus status);
+
+typedef struct
+{
+	uint8_t addr;
+	uint8_t *pTxData;
+	uint16_t txLength;
+	/* Read after a repeated start when both lengths are set */
+	uint8_t *pRxData;
+	uint16_t rxLength;
+	/* Optional, NULL when not used */
+	tI2cHdlrCallback callback;
+	uint32_t token;
+	/* Optional status word: I2C_HDLR_TR_PENDING until the transaction completes */
+	volatile tI2cHdlrTrStatus *pStatus;
+	/* Attempts after a failure, each one after twice the previous backoff */
+	uint8_t retries;
+	/* Descriptors of the same load queued right after this one, 0 when alone.
+	 * The status word is written by the last one, with the first failure of them all */
+	uint8_t chainLeft;
+} tI2cHdlrTr;
+
+/* Register initialisation row, value is sent as stored (MSB first for the devices in use) */
+#define I2C_HDLR_REG_CFG_MAX 4u
+
+typedef struct
+{
+	uint8_t reg;
+	uint8_t length;
+	uint8_t value[I2C_HDLR_REG_CFG_MAX];
+} tI2cHdlrRegCfg;
+
+/* One write transaction: register address followed by the data */
+typedef struct
+{
+	uint8_t *pData;
+	uint16_t length;
+} tI2cHdlrBurst;
+
+/* Worst case merge buffer, no rows adjacent */
+#define I2C_HDLR_CFG_BUFF_LEN(n) ((n) * (1u + I2C_HDLR_REG_CFG_MAX))
+
+/* Register map bitmap size, one bit per register */
+#define I2C_HDLR_SHADOW_MAP_LEN(n) (((n) + 7u) / 8u)
+
+/*
+ * Shadow of the registers 0..regNum-1 of one device, kept up to date by the
+ * completed writes and reads of the bus. Registers flagged in volatileMap
+ * change on their own and are always read from the device.
+ */
+typedef struct
+{
+	uint8_t addr;
+	uint16_t regNum;
+	const uint8_t *volatileMap;
+	uint8_t *value;
+	uint8_t *validMap;
+} tI2cHdlrShadow;
+
 void I2cHdlrInit(void);
 void I2cHdlrRun(void);
 I2cHdlrErrCode I2cHdlrMasterTx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length);
 I2cHdlrErrCode I2cHdlrMasterRx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length);
+I2cHdlrErrCode I2cHdlrMasterWriteRead (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *txData, uint16_t txLength, uint8_t *rxData, uint16_t rxLength);
+uint32_t I2cHdlrCfgMerge (const tI2cHdlrRegCfg *regs, uint32_t regNum, uint8_t *buff, tI2cHdlrBurst *bursts);
+I2cHdlrErrCode I2cHdlrCfgLoad (tI2cHdlrModIdx devIdx, uint8_t addr, const tI2cHdlrBurst *bursts, uint32_t burstNum, volatile tI2cHdlrTrStatus *pStatus);
+I2cHdlrErrCode I2cHdlrShadowAttach (tI2cHdlrModIdx devIdx, tI2cHdlrShadow *shadow);
+I2cHdlrErrCode I2cHdlrRegRead (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *reg, uint8_t *data, uint16_t length, volatile tI2cHdlrTrStatus *pStatus);
 I2cHdlrErrCode I2cHdlrTxRun (tI2cHdlrModIdx devIdx);
 I2cHdlrErrCode I2cHdlrRxRun (tI2cHdlrModIdx devIdx);
 boolean I2cHdlrIsFsmBusy (tI2cHdlrModIdx devIdx);
+I2cHdlrErrCode I2cHdlrEnqueue (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr);
+uint32_t I2cHdlrGetQueueFree (tI2cHdlrModIdx devIdx);
+I2cHdlrErrCode I2cHdlrSetBackend (tI2cHdlrModIdx devIdx, tI2cHdlrBackend backend);
+tI2cHdlrBackend I2cHdlrGetBackend (tI2cHdlrModIdx devIdx);
+I2cHdlrErrCode I2cHdlrSetSpeed (tI2cHdlrModIdx devIdx, tI2cHdlrSpeed speed);
+tI2cHdlrSpeed I2cHdlrGetSpeed (tI2cHdlrModIdx devIdx);
+uint32_t I2cHdlrGetRecoveryCount (tI2cHdlrModIdx devIdx);
+tI2cHdlrTrStatus I2cHdlrGetLastStatus (tI2cHdlrModIdx devIdx);
+void I2cHdlrGetStats (tI2cHdlrModIdx devIdx, tI2cHdlrStats *stats, boolean isClear);
+void I2cHdlrEvIrqHandler (tI2cHdlrModIdx devIdx);
+void I2cHdlrErIrqHandler (tI2cHdlrModIdx devIdx);
+void I2cHdlrDmaTxIrqHandler (tI2cHdlrModIdx devIdx);
+void I2cHdlrDmaRxIrqHandler (tI2cHdlrModIdx devIdx);
+#ifdef I2C_HDLR_SIM
+void I2cHdlrSimAttach (tI2cHdlrModIdx devIdx, void *regs);
+#endif
 #endif
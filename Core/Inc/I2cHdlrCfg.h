@@ -0,0 +1,36 @@
+/**
+  ******************************************************************************
+  * @file           : I2cHdlrCfg.h
+  * @brief          : I2c Handler board configuration header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef I2C_HDLR_CFG_H
+#define I2C_HDLR_CFG_H
+
+typedef struct
+{
+	boolean isEnabled;
+	GPIO_TypeDef *sclPort;
+	uint16_t sclPin;
+	GPIO_TypeDef *sdaPort;
+	uint16_t sdaPin;
+	uint8_t alternate;
+	tI2cHdlrSpeed speed;
+	tI2cHdlrBackend backend;
+} tI2cHdlrBusCfg;
+
+/* Row n configures I2Cn, indexed by tI2cHdlrModIdx */
+extern const tI2cHdlrBusCfg i2cHdlrBusCfg[I2C_HDLR_MOD_NUM];
+
+#endif
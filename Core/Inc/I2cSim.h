@@ -0,0 +1,29 @@
+/**
+  ******************************************************************************
+  * @file           : I2cSim.h
+  * @brief          : I2c peripheral model header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+/* Bus moved onto the model and address of the simulated device */
+#define I2C_SIM_BUS		I2C_HDLR_MOD3
+#define I2C_SIM_DEV_ADDR	0xA0u
+
+void I2cSimInit(void);
+void I2cSimRun(void);
+void I2cSimSetStretch(uint32_t steps);
+void I2cSimInjectNack(boolean isAddrNack, uint32_t dataByte);
+#endif
@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file           : NvmHdlr.h
+  * @brief          : Persistent settings handler header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef NVM_HDLR_H
+#define NVM_HDLR_H
+
+typedef enum
+{
+	NVM_HDLR_OK = 0,
+	NVM_HDLR_NODATA,
+	NVM_HDLR_ERR
+}NvmHdlrErrCode;
+
+/*
+ * Settings kept over a power cycle, one record per change. The values are
+ * stored in flash: a key keeps its number, new ones go at the end. Volume and
+ * AGC profile once per amplifier zone, zone A keeps the single zone keys.
+ */
+typedef enum
+{
+	NVM_HDLR_KEY_VOLUME = 0,
+	NVM_HDLR_KEY_CURVE,
+	NVM_HDLR_KEY_AGC,
+	/* Zones B and up */
+	NVM_HDLR_KEY_ZONE_VOLUME,
+	NVM_HDLR_KEY_ZONE_AGC = NVM_HDLR_KEY_ZONE_VOLUME + AMP_HDLR_ZONE_NUM - 1,
+	NVM_HDLR_KEY_NUM = NVM_HDLR_KEY_ZONE_AGC + AMP_HDLR_ZONE_NUM - 1
+} tNvmHdlrKey;
+
+#define NVM_HDLR_KEY_VOLUME_OF(z) ((tNvmHdlrKey)(((z) == 0u) ? NVM_HDLR_KEY_VOLUME : (NVM_HDLR_KEY_ZONE_VOLUME + (z) - 1u)))
+#define NVM_HDLR_KEY_AGC_OF(z) ((tNvmHdlrKey)(((z) == 0u) ? NVM_HDLR_KEY_AGC : (NVM_HDLR_KEY_ZONE_AGC + (z) - 1u)))
+
+typedef struct
+{
+	/* Records in use and still free in the sector */
+	uint32_t used;
+	uint32_t free;
+	uint32_t appendCnt;
+	uint32_t compactCnt;
+	/* Program, erase or read back failures */
+	uint32_t errCnt;
+} tNvmHdlrStats;
+
+void NvmHdlrInit(void);
+void NvmHdlrRun(void);
+NvmHdlrErrCode NvmHdlrGet(tNvmHdlrKey key, uint32_t *value);
+NvmHdlrErrCode NvmHdlrSet(tNvmHdlrKey key, uint32_t value);
+void NvmHdlrGetStats(tNvmHdlrStats *stats);
+#endif
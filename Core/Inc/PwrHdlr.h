@@ -0,0 +1,45 @@
+/**
+  ******************************************************************************
+  * @file           : PwrHdlr.h
+  * @brief          : Power save handler header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef PWR_HDLR_H
+#define PWR_HDLR_H
+
+typedef enum
+{
+	PWR_HDLR_ACTIVE = 0,
+	/* Amplifier shut down, the core sleeps between interrupts */
+	PWR_HDLR_STANDBY,
+	PWR_HDLR_STATE_NUM
+} tPwrHdlrState;
+
+typedef struct
+{
+	/* Residency per state */
+	uint32_t stateMs[PWR_HDLR_STATE_NUM];
+	/* Standby only: cycles the core was running and WFI entries, it slept the rest of the time */
+	uint64_t awakeCycles;
+	uint32_t sleepCnt;
+	/* Standby exits, longest cycles from the waking event to the amplifier back on */
+	uint32_t wakeCnt;
+	uint32_t wakeLatencyMax;
+} tPwrHdlrStats;
+
+void PwrHdlrInit(void);
+void PwrHdlrRun(void);
+void PwrHdlrWakeDone(uint32_t stamp);
+void PwrHdlrGetStats(tPwrHdlrStats *stats, boolean isClear);
+#endif
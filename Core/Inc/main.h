@@ -30,10 +30,16 @@ extern "C" {
 #include "stm32f4xx_hal.h"
 #include "Types.h"
 #include "I2cHdlr.h"
-#include "AmpHdlr.h"
+#include "I2cHdlrCfg.h"
+#include "I2cBench.h"
+#include "I2cSim.h"
+#include "DevHdlr.h"
 #include "EncHdlr.h"
+#include "AmpHdlr.h"
 #include "ComHdlrDebug.h"
 #include "DebugHdlr.h"
+#include "PwrHdlr.h"
+#include "NvmHdlr.h"
 #include "Timer.h"
 
 /* Private includes ----------------------------------------------------------*/
@@ -1,198 +1,774 @@
-/**
-  ******************************************************************************
-  * @file           : AmpHdlr.c
-  * @brief          : Amplifier Handler
-  ******************************************************************************
-  * @attention
-  *
-  * Copyright (c) 2023 EmbeddedEspresso.
-  * All rights reserved.
-  *
-  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
-  * license. You may not use this file except in compliance with the License.
-  * You may obtain a copy of the License at:
-  * opensource.org/licenses/BSD-3-Clause
-  ******************************************************************************
-  */
-
-#include "main.h"
-
-#define AMP_CFG_LENGTH 2u
-
-typedef enum
-{
-    AMP_HDLR_INIT = 0,
-	AMP_HDLR_CFG,
-	AMP_HDLR_CFG_WAIT,
-	AMP_HDLR_PREIDLE,
-	AMP_HDLR_IDLE,
-	AMP_HDLR_GETGAINTX,
-	AMP_HDLR_GETGAINTX_WAIT,
-	AMP_HDLR_GETGAINRX,
-	AMP_HDLR_GETGAINRX_WAIT,
-	AMP_HDLR_SETGAINTX,
-	AMP_HDLR_SETGAINTX_WAIT
-} tAmpHdlrFsmSts;
-
-typedef struct
-{
-	uint8_t cnf[5];
-	uint32_t length;
-}tAmpHdlrCfg;
-
-static tAmpHdlrFsmSts fsmsts;
-static uint16_t devAddress = 0xB0;
-/* Provide a configuration struct */
-/* Improvement: Use the INT pin to trigger encoder read */
-
-static tAmpHdlrCfg ampRegConf[AMP_CFG_LENGTH] = { { {0x07u, 0xC0u}, 0x02u },
-		 	 	 	 	 	 	 	 	 	 	  { {0x03u, 0x01u}, 0x02u }
-												};
-
-
-static uint8_volume;
-static uint8_t isVolumeChanged;
-
-static uint8_t ampValPosRegAddr = 0x05;
-static tAmpHdlrCfg ampSetGainCmd = { {0x05u, 0x00u}, 0x02u };
-
-static uint8_t dataReg[4] = {0};
-static char debugLocalStr[256];
-
-static uint8_t ampSetGain = 0u;
-static uint8_t ampGain = 0u;
-
-AmpHdlrErrCode AmpHdlrInit (void)
-{
-	fsmsts = AMP_HDLR_INIT;
-}
-
-AmpHdlrErrCode AmpHdlrRun (void)
-{
-	AmpHdlrErrCode result = AMP_HDLR_OK;
-	static int tmr;
-    static int idx = 0u;
-    static int cfgIdx = 0u;
-
-    float tempVal = 0;
-    float tempValDec;
-
-
-	switch (fsmsts)
-	{
-		case AMP_HDLR_INIT:
-			/* Start with the initialization */
-			/* Copy here */
-			if (AMP_CFG_LENGTH > 0u)
-			{
-				fsmsts = AMP_HDLR_CFG;
-			}
-			else
-			{
-				fsmsts = AMP_HDLR_PREIDLE;
-			}
-			break;
-
-		case AMP_HDLR_CFG:
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD2, devAddress, ampRegConf[cfgIdx].cnf, ampRegConf[cfgIdx].length) == AMP_HDLR_OK)
-			{
-				fsmsts = AMP_HDLR_CFG_WAIT;
-			}
-			break;
-
-		case AMP_HDLR_CFG_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD2) == FALSE)
-			{
-				cfgIdx++;
-				if (cfgIdx < AMP_CFG_LENGTH)
-				{
-					fsmsts = AMP_HDLR_CFG;
-				}
-				else
-				{
-					fsmsts = AMP_HDLR_PREIDLE;
-				}
-	            TimerSet(&tmr, 1000);
-			}
-			break;
-
-		case AMP_HDLR_PREIDLE:
-            PRINT_DEBUG("[Amplifier]: Initialization completed\r\n");
-            fsmsts = AMP_HDLR_IDLE;
-            break;
-
-		case AMP_HDLR_IDLE:
-			if (ampSetGain == 1u)
-			{
-				ampSetGain = 0u;
-				fsmsts = AMP_HDLR_SETGAINTX;
-			}
-			else
-			{
-				if (isTimerExpired(tmr))
-				{
-					fsmsts = AMP_HDLR_GETGAINTX;
-				}
-			}
-			break;
-
-		case AMP_HDLR_GETGAINTX:
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD2, devAddress, &ampValPosRegAddr, 1) == I2C_HDLR_OK)
-			{
-				fsmsts = AMP_HDLR_GETGAINTX_WAIT;
-			}
-			break;
-
-		case AMP_HDLR_GETGAINTX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD2) == FALSE)
-			{
-				fsmsts = AMP_HDLR_GETGAINRX;
-			}
-			break;
-
-		case AMP_HDLR_GETGAINRX:
-			if (I2cHdlrMasterRx(I2C_HDLR_MOD2, devAddress, dataReg, 1) == I2C_HDLR_OK)
-			{
-				fsmsts = AMP_HDLR_GETGAINRX_WAIT;
-			}
-			break;
-
-		case AMP_HDLR_GETGAINRX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD2) == FALSE)
-			{
-                sprintf(debugLocalStr, "[Amplifier]: Gain value: %d\r\n", dataReg[0]);
-				PRINT_DEBUG(debugLocalStr);
-				fsmsts = AMP_HDLR_IDLE;
-	            TimerSet(&tmr, 1000);
-			}
-			break;
-
-		case AMP_HDLR_SETGAINTX:
-			ampSetGainCmd.cnf[1] = ampGain*2;
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD2, devAddress, ampSetGainCmd.cnf, ampSetGainCmd.length) == AMP_HDLR_OK)
-			{
-				fsmsts = AMP_HDLR_SETGAINTX_WAIT;
-			}
-			break;
-
-		case AMP_HDLR_SETGAINTX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD2) == FALSE)
-			{
-				fsmsts = AMP_HDLR_IDLE;
-	            TimerSet(&tmr, 1000);
-	            PRINT_DEBUG("[Amplifier]: Gain updated\r\n");
-			}
-			break;
-
-	}
-
-	return result;
-}
-
-AmpHdlrErrCode AmpHdlrSetGain (uint8_t gain)
-{
-	ampSetGain = 1u;
-	ampGain = gain;
-
-	return AMP_HDLR_OK;
-}
+/**
+  ******************************************************************************
+  * @file           : AmpHdlr.c
+  * @brief          : Amplifier Handler
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+#define AMP_REG_NUM 8u
+#define AMP_DEV_ADDR 0xB0u
+#define AMP_CFG_LENGTH 4u
+#define AMP_GAIN_REG 0x05u
+/* Register 1: speaker enables, software shutdown, fault flags, noise gate */
+#define AMP_CTRL_REG 0x01u
+#define AMP_CTRL_SPK_EN_R 0x80u
+#define AMP_CTRL_SPK_EN_L 0x40u
+#define AMP_CTRL_SWS 0x20u
+#define AMP_CTRL_FAULT_R 0x10u
+#define AMP_CTRL_FAULT_L 0x08u
+#define AMP_CTRL_THERMAL 0x04u
+#define AMP_CTRL_NG_EN 0x01u
+#define AMP_CTRL_FAULT_MASK (AMP_CTRL_FAULT_R | AMP_CTRL_FAULT_L | AMP_CTRL_THERMAL)
+/* Power-on value less the noise gate, and the same with the outputs off. Both clear the fault flags */
+#define AMP_CTRL_ON 0xC2u
+#define AMP_CTRL_MUTE (AMP_CTRL_ON & ~(AMP_CTRL_SPK_EN_R | AMP_CTRL_SPK_EN_L))
+/* AGC: attack, release and hold from 0x02, limiter/noise gate threshold and max gain/compression from 0x06 */
+#define AMP_AGC_TIME_REG 0x02u
+#define AMP_AGC_LIMIT_REG 0x06u
+#define AMP_AGC_TIME_MASK 0x3Fu
+/* Compression ratio field of 0x07, 1:1 (off) when clear */
+#define AMP_AGC_RATIO_MASK 0x03u
+/* Software shutdown with no knob touched, or with the volume at the bottom */
+#define AMP_SLEEP_IDLE_MS (10u * 60u * 1000u)
+#define AMP_SLEEP_MIN_VOL_MS (60u * 1000u)
+/* No knob touched for this long: idle, long flash operations are allowed */
+#define AMP_QUIET_MS (30u * 1000u)
+/* Status poll: fast after a change, doubled on every quiet read up to the slow period */
+#define AMP_POLL_FAST_MS 50u
+#define AMP_POLL_SLOW_MS 4000u
+/* Re-enable after a fault, delay doubled while the fault comes back */
+#define AMP_RETRY_MIN_MS 500u
+#define AMP_RETRY_MAX_MS 16000u
+#define AMP_STATUS_ITEM 0u
+/* Gain ramp, one 1 dB register step per period */
+#define AMP_RAMP_MS_PER_DB_DEFAULT 4u
+/* Fixed gain, 6 bit two's complement in dB, 6 dB at power-on */
+#define AMP_GAIN_MIN_DB (-28)
+#define AMP_GAIN_MAX_DB 30
+#define AMP_GAIN_RESET_DB 6
+/* With compression on, the fixed gain is only valid from 0 dB up */
+#define AMP_GAIN_MIN_AGC_DB 0
+#define AMP_GAIN_CODE(db) ((uint8_t)(db) & 0x3Fu)
+
+/*
+ * Volume curves, evaluated by the compiler: gain at knob position p, linear
+ * between the points and rounded to the nearest dB. Points in increasing
+ * order, for both the position and the gain.
+ */
+#define AMP_VOL_LERP(p, x0, y0, x1, y1) \
+	((y0) + (((2 * ((y1) - (y0)) * ((int32_t)(p) - (int32_t)(x0))) + ((int32_t)(x1) - (int32_t)(x0))) / \
+			 (2 * ((int32_t)(x1) - (int32_t)(x0)))))
+#define AMP_VOL_PWL(p, x0, y0, x1, y1, x2, y2, x3, y3) \
+	(((p) <= (x1)) ? AMP_VOL_LERP(p, x0, y0, x1, y1) : \
+	 (((p) <= (x2)) ? AMP_VOL_LERP(p, x1, y1, x2, y2) : AMP_VOL_LERP(p, x2, y2, x3, y3)))
+/* Same dB step all along */
+#define AMP_VOL_LINEAR(p) AMP_VOL_LERP(p, 0, AMP_GAIN_MIN_DB, AMP_HDLR_VOL_POS_MAX, AMP_GAIN_MAX_DB)
+/* Coarse where it is barely audible or already loud, most of the travel in the listening range */
+#define AMP_VOL_LOUDNESS(p) AMP_VOL_PWL(p, 0, AMP_GAIN_MIN_DB, 6, -10, 26, 18, AMP_HDLR_VOL_POS_MAX, AMP_GAIN_MAX_DB)
+/* Free points for the enclosure in use */
+#define AMP_VOL_CUSTOM(p) AMP_VOL_PWL(p, 0, AMP_GAIN_MIN_DB, 8, -12, 24, 6, AMP_HDLR_VOL_POS_MAX, AMP_GAIN_MAX_DB)
+/*
+ * Gain range of the curves: the full one, or the same curve scaled into
+ * the 0..30 dB a compressing AGC profile allows, so the whole knob travel
+ * stays usable.
+ */
+#define AMP_VOL_FULL(db) (db)
+#define AMP_VOL_AGC(db) \
+	(AMP_GAIN_MIN_AGC_DB + (((2 * ((db) - AMP_GAIN_MIN_DB) * (AMP_GAIN_MAX_DB - AMP_GAIN_MIN_AGC_DB)) + \
+							 (AMP_GAIN_MAX_DB - AMP_GAIN_MIN_DB)) / (2 * (AMP_GAIN_MAX_DB - AMP_GAIN_MIN_DB))))
+/* Positions 0..AMP_HDLR_VOL_POS_MAX of curve c in range r */
+#define AMP_VOL_TABLE(c, r) { r(c(0)),  r(c(1)),  r(c(2)),  r(c(3)),  r(c(4)),  r(c(5)),  r(c(6)),  r(c(7)),  \
+							  r(c(8)),  r(c(9)),  r(c(10)), r(c(11)), r(c(12)), r(c(13)), r(c(14)), r(c(15)), \
+							  r(c(16)), r(c(17)), r(c(18)), r(c(19)), r(c(20)), r(c(21)), r(c(22)), r(c(23)), \
+							  r(c(24)), r(c(25)), r(c(26)), r(c(27)), r(c(28)), r(c(29)), r(c(30)), r(c(31)), \
+							  r(c(32)) }
+
+
+/* Per zone write items, in register order, pointing to the zone register images */
+typedef enum
+{
+	AMP_VOL_RANGE_FULL = 0,
+	AMP_VOL_RANGE_AGC,
+	AMP_VOL_RANGE_NUM
+} tAmpHdlrVolRange;
+
+#define AMP_ZONE_WRITES(z) { {AMP_CTRL_REG, 1u, &ampZone[z].ctrlReg, AmpHdlrCtrlWritten}, \
+							 {AMP_AGC_TIME_REG, 3u, ampZone[z].agcTimeReg, AmpHdlrAgcWritten}, \
+							 {AMP_GAIN_REG, 1u, &ampZone[z].gainReg, AmpHdlrGainWritten}, \
+							 {AMP_AGC_LIMIT_REG, 2u, ampZone[z].agcLimitReg, AmpHdlrAgcWritten} }
+
+typedef struct
+{
+	/* Registers 1..7 as the device gets them */
+	uint8_t ctrlReg;
+	uint8_t agcTimeReg[3];
+	uint8_t gainReg;
+	uint8_t agcLimitReg[2];
+	/* The write items as restored at boot, one burst over 0x01..0x07 */
+	tI2cHdlrRegCfg regConf[AMP_CFG_LENGTH];
+	tI2cHdlrShadow shadow;
+	uint8_t shadowValue[AMP_REG_NUM];
+	uint8_t shadowValid[I2C_HDLR_SHADOW_MAP_LEN(AMP_REG_NUM)];
+	/* Device engine index */
+	uint32_t engDev;
+	tAmpHdlrAgcId agcId;
+	boolean isNoiseGate;
+	boolean isAgcPending;
+	/* Outputs off for a fault, or on request */
+	boolean isMuted;
+	boolean isUserMuted;
+	uint32_t pollPeriod;
+	uint32_t retryDelay;
+	int retryTmr;
+	uint32_t faultCnt;
+	/* Own message buffer, the zones report in the same pass */
+	char debugStr[80];
+	/* Newest requested gain in dB, the ramp steps gainDb towards it */
+	uint8_t volPos;
+	/* Gain range of the loaded AGC profile */
+	tAmpHdlrVolRange volRange;
+	int8_t gainTarget;
+	int8_t gainDb;
+	int rampTmr;
+	boolean isGainBusy;
+} tAmpHdlrZoneInst;
+
+typedef struct
+{
+	boolean isEnabled;
+	tDevHdlrDesc desc;
+} tAmpHdlrZoneCfg;
+
+static void AmpHdlrStatusRead (uint32_t dev, const uint8_t *data, tI2cHdlrTrStatus status);
+static void AmpHdlrGainWritten (uint32_t dev, tI2cHdlrTrStatus status);
+static void AmpHdlrCtrlWritten (uint32_t dev, tI2cHdlrTrStatus status);
+static void AmpHdlrAgcWritten (uint32_t dev, tI2cHdlrTrStatus status);
+
+/* Only the fault/status register (1) changes without being written */
+static const uint8_t ampShadowVolatile[I2C_HDLR_SHADOW_MAP_LEN(AMP_REG_NUM)] = {0x02u};
+
+
+static const int8_t ampVolTable[AMP_VOL_RANGE_NUM][AMP_HDLR_CURVE_NUM][AMP_HDLR_VOL_POS_MAX + 1u] =
+{
+	{
+		AMP_VOL_TABLE(AMP_VOL_LINEAR, AMP_VOL_FULL),
+		AMP_VOL_TABLE(AMP_VOL_LOUDNESS, AMP_VOL_FULL),
+		AMP_VOL_TABLE(AMP_VOL_CUSTOM, AMP_VOL_FULL),
+	},
+	{
+		AMP_VOL_TABLE(AMP_VOL_LINEAR, AMP_VOL_AGC),
+		AMP_VOL_TABLE(AMP_VOL_LOUDNESS, AMP_VOL_AGC),
+		AMP_VOL_TABLE(AMP_VOL_CUSTOM, AMP_VOL_AGC),
+	},
+};
+
+static const tAmpHdlrAgcProfile ampAgcProfiles[AMP_HDLR_AGC_NUM] =
+{
+	/* Flat: compression off */
+	{ 0x05u, 0x01u, 0x00u, 0x3Au, 0xC0u, TRUE },
+	/* Speech: fast attack, 4:1 up to 30 dB, gate between the words */
+	{ 0x02u, 0x0Bu, 0x00u, 0x3Au, 0xC2u, TRUE },
+	/* Music: slow release keeps the dynamics, 2:1 up to 27 dB, no gate */
+	{ 0x05u, 0x20u, 0x00u, 0x3Au, 0x91u, FALSE },
+	/* Night: 8:1 up to 30 dB and a 3.5 dBV limiter, quiet passages brought up */
+	{ 0x01u, 0x10u, 0x02u, 0x34u, 0xC3u, TRUE },
+};
+static tEncHdlrReader ampEncReader;
+
+static tAmpHdlrZoneInst ampZone[AMP_HDLR_ZONE_NUM];
+/* Zones moved by each encoder, the volume knob is the master of all of them */
+static uint32_t ampGroupMask[ENC_HDLR_DEV_NUM] = {AMP_HDLR_ZONE_ALL, 0u, 0u};
+
+static boolean ampIsAsleep = FALSE;
+static int ampIdleTmr;
+static int ampQuietTmr;
+static int ampMinVolTmr;
+/* CYCCNT of the event that woke the amplifiers, reported once the first one is back on */
+static boolean ampIsWaking = FALSE;
+static uint32_t ampWakeStamp;
+
+static tAmpHdlrCurve ampCurve = AMP_HDLR_CURVE_LOUDNESS;
+static uint32_t ampRampMsPerDb = AMP_RAMP_MS_PER_DB_DEFAULT;
+
+/* Register 1 is volatile in the shadow, the gain is known and never polled */
+static const tDevHdlrRead ampReads[] = { {AMP_CTRL_REG, 1u, AMP_POLL_SLOW_MS, AmpHdlrStatusRead} };
+/* 0x01..0x07 are contiguous, a profile switch goes out as a single burst */
+static const tDevHdlrWrite ampWrites[AMP_HDLR_ZONE_NUM][AMP_CFG_LENGTH] =
+{
+	AMP_ZONE_WRITES(AMP_HDLR_ZONE_A),
+	AMP_ZONE_WRITES(AMP_HDLR_ZONE_B),
+	AMP_ZONE_WRITES(AMP_HDLR_ZONE_C),
+};
+
+/*
+ * The TPA2016D2 address is fixed, one per bus. Each zone is served on its
+ * own bus so the writes of a group change run side by side.
+ */
+static const tAmpHdlrZoneCfg ampZoneCfg[AMP_HDLR_ZONE_NUM] =
+{
+	{ TRUE, { "Amplifier A", I2C_HDLR_MOD2, AMP_DEV_ADDR, ampZone[AMP_HDLR_ZONE_A].regConf, AMP_CFG_LENGTH,
+			  ampReads, sizeof(ampReads) / sizeof(ampReads[0]), ampWrites[AMP_HDLR_ZONE_A], AMP_CFG_LENGTH,
+			  &ampZone[AMP_HDLR_ZONE_A].shadow } },
+	{ FALSE, { "Amplifier B", I2C_HDLR_MOD1, AMP_DEV_ADDR, ampZone[AMP_HDLR_ZONE_B].regConf, AMP_CFG_LENGTH,
+			   ampReads, sizeof(ampReads) / sizeof(ampReads[0]), ampWrites[AMP_HDLR_ZONE_B], AMP_CFG_LENGTH,
+			   &ampZone[AMP_HDLR_ZONE_B].shadow } },
+	{ FALSE, { "Amplifier C", I2C_HDLR_MOD3, AMP_DEV_ADDR, ampZone[AMP_HDLR_ZONE_C].regConf, AMP_CFG_LENGTH,
+			   ampReads, sizeof(ampReads) / sizeof(ampReads[0]), ampWrites[AMP_HDLR_ZONE_C], AMP_CFG_LENGTH,
+			   &ampZone[AMP_HDLR_ZONE_C].shadow } },
+};
+
+/* Zone served by a device engine index, AMP_HDLR_ZONE_NUM if none */
+static uint32_t AmpHdlrZoneFind (uint32_t dev)
+{
+	uint32_t result = AMP_HDLR_ZONE_NUM;
+	uint32_t z;
+
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		if ( (ampZoneCfg[z].isEnabled == TRUE) && (ampZone[z].engDev == dev) )
+		{
+			result = z;
+		}
+	}
+
+	return result;
+}
+
+/* Gain of the knob position on the curve, in the range the AGC profile of the zone allows */
+static int8_t AmpHdlrVolGain (uint32_t z)
+{
+	return ampVolTable[ampZone[z].volRange][ampCurve][ampZone[z].volPos];
+}
+
+/* Every write of register 1 also clears the fault flags */
+static void AmpHdlrCtrlUpdate (uint32_t z)
+{
+	tAmpHdlrZoneInst *zone = &ampZone[z];
+	uint8_t ctrl = ( (zone->isMuted == TRUE) || (zone->isUserMuted == TRUE) ) ? AMP_CTRL_MUTE : AMP_CTRL_ON;
+
+	if (zone->isNoiseGate == TRUE)
+	{
+		ctrl |= AMP_CTRL_NG_EN;
+	}
+	if (ampIsAsleep == TRUE)
+	{
+		ctrl |= AMP_CTRL_SWS;
+	}
+	zone->ctrlReg = ctrl;
+}
+
+/* Not while shut down, the status is not polled then */
+static void AmpHdlrPollFast (uint32_t z)
+{
+	if ( (ampIsAsleep != TRUE) && (ampZoneCfg[z].isEnabled == TRUE) )
+	{
+		ampZone[z].pollPeriod = AMP_POLL_FAST_MS;
+		DevHdlrSetPeriod(ampZone[z].engDev, AMP_STATUS_ITEM, ampZone[z].pollPeriod);
+	}
+}
+
+static void AmpHdlrStatusRead (uint32_t dev, const uint8_t *data, tI2cHdlrTrStatus status)
+{
+	uint32_t z = AmpHdlrZoneFind(dev);
+	tAmpHdlrZoneInst *zone;
+
+	if ( (z == AMP_HDLR_ZONE_NUM) || (ampIsAsleep == TRUE) )
+	{
+		/* Read queued before the shutdown, polling stays off */
+	}
+	else if ( (status == I2C_HDLR_TR_OK) && (ampZone[z].isMuted != TRUE) && ((data[0] & AMP_CTRL_FAULT_MASK) != 0u) )
+	{
+		/* Outputs off, the flags are cleared by the same write */
+		zone = &ampZone[z];
+		zone->isMuted = TRUE;
+		AmpHdlrCtrlUpdate(z);
+		zone->faultCnt++;
+		TimerSet(&zone->retryTmr, (int)zone->retryDelay);
+		sprintf(zone->debugStr, "[%s]: Fault 0x%02X (%u), muted for %u ms\r\n", ampZoneCfg[z].desc.name,
+				data[0], (unsigned int)zone->faultCnt, (unsigned int)zone->retryDelay);
+		PRINT_DEBUG(zone->debugStr);
+		AmpHdlrPollFast(z);
+	}
+	else if (ampZone[z].pollPeriod < AMP_POLL_SLOW_MS)
+	{
+		zone = &ampZone[z];
+		zone->pollPeriod *= 2u;
+		if (zone->pollPeriod >= AMP_POLL_SLOW_MS)
+		{
+			zone->pollPeriod = AMP_POLL_SLOW_MS;
+			if (zone->isMuted != TRUE)
+			{
+				/* Quiet for a while since the last change, the next fault starts over */
+				zone->retryDelay = AMP_RETRY_MIN_MS;
+			}
+		}
+		DevHdlrSetPeriod(dev, AMP_STATUS_ITEM, zone->pollPeriod);
+	}
+}
+
+static void AmpHdlrCtrlWritten (uint32_t dev, tI2cHdlrTrStatus status)
+{
+	uint32_t z = AmpHdlrZoneFind(dev);
+
+	if (z == AMP_HDLR_ZONE_NUM)
+	{
+		/* Not an amplifier */
+	}
+	else if (status != I2C_HDLR_TR_OK)
+	{
+		sprintf(ampZone[z].debugStr, "[%s]: Control update failed (%d)\r\n", ampZoneCfg[z].desc.name, status);
+		PRINT_DEBUG(ampZone[z].debugStr);
+	}
+	else if ( (ampIsWaking == TRUE) && ((ampZone[z].ctrlReg & AMP_CTRL_SWS) == 0u) )
+	{
+		ampIsWaking = FALSE;
+		PwrHdlrWakeDone(ampWakeStamp);
+	}
+}
+
+/* Any knob event, the first one also ends a shutdown */
+static void AmpHdlrActivity (uint32_t stamp)
+{
+	uint32_t z;
+
+	TimerSet(&ampIdleTmr, (int)AMP_SLEEP_IDLE_MS);
+	TimerSet(&ampQuietTmr, (int)AMP_QUIET_MS);
+	if (ampIsAsleep == TRUE)
+	{
+		ampIsAsleep = FALSE;
+		ampIsWaking = TRUE;
+		ampWakeStamp = stamp;
+		for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+		{
+			/* A fault pending before the shutdown is retried right away */
+			ampZone[z].isMuted = FALSE;
+			AmpHdlrCtrlUpdate(z);
+			AmpHdlrPollFast(z);
+		}
+		PRINT_DEBUG("[Amplifier]: Waking up\r\n");
+	}
+}
+
+/* Every zone in use at the bottom of its volume range */
+static boolean AmpHdlrIsMinVolume (void)
+{
+	boolean result = TRUE;
+	uint32_t z;
+
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		if ( (ampZoneCfg[z].isEnabled == TRUE) && (ampZone[z].volPos != 0u) )
+		{
+			result = FALSE;
+		}
+	}
+
+	return result;
+}
+
+/* All zones together, one control surface for them all */
+static void AmpHdlrSleepRun (void)
+{
+	uint32_t z;
+
+	if ( (ampIsAsleep != TRUE) &&
+		 (isTimerExpired(ampIdleTmr) || ((AmpHdlrIsMinVolume() == TRUE) && isTimerExpired(ampMinVolTmr))) )
+	{
+		ampIsAsleep = TRUE;
+		ampIsWaking = FALSE;
+		for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+		{
+			AmpHdlrCtrlUpdate(z);
+			if (ampZoneCfg[z].isEnabled == TRUE)
+			{
+				DevHdlrSetPeriod(ampZone[z].engDev, AMP_STATUS_ITEM, 0u);
+			}
+		}
+		PRINT_DEBUG("[Amplifier]: Shut down\r\n");
+	}
+}
+
+/* Both AGC items report the same burst, one message per profile */
+static void AmpHdlrAgcWritten (uint32_t dev, tI2cHdlrTrStatus status)
+{
+	uint32_t z = AmpHdlrZoneFind(dev);
+
+	if ( (z != AMP_HDLR_ZONE_NUM) && (ampZone[z].isAgcPending == TRUE) )
+	{
+		ampZone[z].isAgcPending = FALSE;
+		if (status == I2C_HDLR_TR_OK)
+		{
+			sprintf(ampZone[z].debugStr, "[%s]: AGC profile loaded\r\n", ampZoneCfg[z].desc.name);
+		}
+		else
+		{
+			sprintf(ampZone[z].debugStr, "[%s]: AGC profile failed (%d)\r\n", ampZoneCfg[z].desc.name, status);
+		}
+		PRINT_DEBUG(ampZone[z].debugStr);
+	}
+}
+
+/*
+ * A batch queued before the last step can carry the gain register bridged
+ * with an older code: the step is on the device only once the shadow holds
+ * the code the ramp wrote. A failed step stays busy, the engine sends it again.
+ */
+static void AmpHdlrGainWritten (uint32_t dev, tI2cHdlrTrStatus status)
+{
+	uint32_t z = AmpHdlrZoneFind(dev);
+
+	if (z != AMP_HDLR_ZONE_NUM)
+	{
+		if (status != I2C_HDLR_TR_OK)
+		{
+			sprintf(ampZone[z].debugStr, "[%s]: Gain update failed (%d)\r\n", ampZoneCfg[z].desc.name, status);
+			PRINT_DEBUG(ampZone[z].debugStr);
+		}
+		else if (ampZone[z].shadowValue[AMP_GAIN_REG] == ampZone[z].gainReg)
+		{
+			ampZone[z].isGainBusy = FALSE;
+			if (ampZone[z].gainDb == ampZone[z].gainTarget)
+			{
+				sprintf(ampZone[z].debugStr, "[%s]: Gain updated\r\n", ampZoneCfg[z].desc.name);
+				PRINT_DEBUG(ampZone[z].debugStr);
+			}
+		}
+	}
+}
+
+/*
+ * One step per period and only once the previous step is on the device: the
+ * write rate is capped whatever the knob does, targets set meanwhile just
+ * replace each other. The zones step in the same pass, the engine queues
+ * their writes on their own buses together.
+ */
+static void AmpHdlrRampRun (void)
+{
+	tAmpHdlrZoneInst *zone;
+	uint32_t z;
+
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		zone = &ampZone[z];
+		if ( (ampZoneCfg[z].isEnabled == TRUE) && (zone->gainDb != zone->gainTarget) &&
+			 (zone->isGainBusy != TRUE) && isTimerExpired(zone->rampTmr) )
+		{
+			if (ampRampMsPerDb == 0u)
+			{
+				zone->gainDb = zone->gainTarget;
+			}
+			else if (zone->gainDb < zone->gainTarget)
+			{
+				zone->gainDb++;
+			}
+			else
+			{
+				zone->gainDb--;
+			}
+			zone->gainReg = AMP_GAIN_CODE(zone->gainDb);
+			zone->isGainBusy = TRUE;
+			TimerSet(&zone->rampTmr, (int)ampRampMsPerDb);
+			AmpHdlrPollFast(z);
+		}
+	}
+}
+
+/* Fault retries, a fault coming back waits twice as long */
+static void AmpHdlrRetryRun (void)
+{
+	tAmpHdlrZoneInst *zone;
+	uint32_t z;
+
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		zone = &ampZone[z];
+		if ( (zone->isMuted == TRUE) && (ampIsAsleep != TRUE) && isTimerExpired(zone->retryTmr) )
+		{
+			zone->isMuted = FALSE;
+			AmpHdlrCtrlUpdate(z);
+			if (zone->retryDelay < AMP_RETRY_MAX_MS)
+			{
+				zone->retryDelay *= 2u;
+			}
+			sprintf(zone->debugStr, "[%s]: Outputs re-enabled\r\n", ampZoneCfg[z].desc.name);
+			PRINT_DEBUG(zone->debugStr);
+			AmpHdlrPollFast(z);
+		}
+	}
+}
+
+/* One knob change to every zone of its group, each keeps its own position */
+static void AmpHdlrGroupStep (uint32_t zoneMask, int32_t delta)
+{
+	int32_t pos;
+	uint32_t z;
+
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		if ( (zoneMask & AMP_HDLR_ZONE_BIT(z)) != 0u )
+		{
+			pos = (int32_t)ampZone[z].volPos + delta;
+			if (pos < 0)
+			{
+				pos = 0;
+			}
+			else if (pos > (int32_t)AMP_HDLR_VOL_POS_MAX)
+			{
+				pos = (int32_t)AMP_HDLR_VOL_POS_MAX;
+			}
+			AmpHdlrSetVolume((tAmpHdlrZone)z, (uint8_t)pos);
+		}
+	}
+}
+
+/* Last saved settings of a zone, defaults for the ones never saved or out of range */
+static void AmpHdlrRestore (uint32_t z)
+{
+	tAmpHdlrZoneInst *zone = &ampZone[z];
+	uint32_t value;
+
+	zone->volPos = AMP_HDLR_VOL_POS_DEFAULT;
+	zone->agcId = AMP_HDLR_AGC_FLAT;
+	if ( (NvmHdlrGet(NVM_HDLR_KEY_VOLUME_OF(z), &value) == NVM_HDLR_OK) && (value <= AMP_HDLR_VOL_POS_MAX) )
+	{
+		zone->volPos = (uint8_t)value;
+	}
+	if ( (NvmHdlrGet(NVM_HDLR_KEY_AGC_OF(z), &value) == NVM_HDLR_OK) && (value < AMP_HDLR_AGC_NUM) )
+	{
+		zone->agcId = (tAmpHdlrAgcId)value;
+	}
+}
+
+/*
+ * Before EncHdlrInit, the volume knob starts from the restored position of
+ * the first zone it drives. The gain goes straight to the restored value
+ * with the init burst, there is nothing to ramp.
+ */
+AmpHdlrErrCode AmpHdlrInit (void)
+{
+	tAmpHdlrZoneInst *zone;
+	uint32_t value;
+	uint32_t z;
+	uint32_t idx;
+	uint32_t knobZone = AMP_HDLR_ZONE_NUM;
+
+	if ( (NvmHdlrGet(NVM_HDLR_KEY_CURVE, &value) == NVM_HDLR_OK) && (value < AMP_HDLR_CURVE_NUM) )
+	{
+		ampCurve = (tAmpHdlrCurve)value;
+	}
+	for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+	{
+		zone = &ampZone[z];
+		AmpHdlrRestore(z);
+		zone->isMuted = FALSE;
+		zone->isUserMuted = FALSE;
+		zone->pollPeriod = AMP_POLL_SLOW_MS;
+		zone->retryDelay = AMP_RETRY_MIN_MS;
+		AmpHdlrSetAgcProfile((tAmpHdlrZone)z, &ampAgcProfiles[zone->agcId]);
+		zone->isAgcPending = FALSE;
+		zone->gainTarget = AmpHdlrVolGain(z);
+		zone->gainDb = zone->gainTarget;
+		zone->gainReg = AMP_GAIN_CODE(zone->gainDb);
+		zone->isGainBusy = FALSE;
+		for (idx = 0u; idx < AMP_CFG_LENGTH; idx++)
+		{
+			zone->regConf[idx].reg = ampWrites[z][idx].reg;
+			zone->regConf[idx].length = ampWrites[z][idx].length;
+			memcpy(zone->regConf[idx].value, ampWrites[z][idx].pValue, ampWrites[z][idx].length);
+		}
+		zone->shadow.addr = AMP_DEV_ADDR;
+		zone->shadow.regNum = AMP_REG_NUM;
+		zone->shadow.volatileMap = ampShadowVolatile;
+		zone->shadow.value = zone->shadowValue;
+		zone->shadow.validMap = zone->shadowValid;
+		zone->engDev = DEV_HDLR_DEV_MAX;
+		if (ampZoneCfg[z].isEnabled == TRUE)
+		{
+			DevHdlrAttach(&ampZoneCfg[z].desc, &zone->engDev);
+			if ( (knobZone == AMP_HDLR_ZONE_NUM) && ((ampGroupMask[ENC_HDLR_DEV_VOLUME] & AMP_HDLR_ZONE_BIT(z)) != 0u) )
+			{
+				knobZone = z;
+			}
+		}
+	}
+	if (knobZone != AMP_HDLR_ZONE_NUM)
+	{
+		EncHdlrSetStartValue(ENC_HDLR_DEV_VOLUME, (int32_t)ampZone[knobZone].volPos);
+	}
+	TimerSet(&ampMinVolTmr, (int)AMP_SLEEP_MIN_VOL_MS);
+	TimerSet(&ampIdleTmr, (int)AMP_SLEEP_IDLE_MS);
+	EncHdlrReaderInit(&ampEncReader);
+}
+
+AmpHdlrErrCode AmpHdlrRun (void)
+{
+	AmpHdlrErrCode result = AMP_HDLR_OK;
+    tEncHdlrEvent encEvent;
+
+	/* Knob events are taken in order, the engine writes the latest gains */
+	while (EncHdlrRead(&ampEncReader, &encEvent) == ENC_HDLR_OK)
+	{
+		AmpHdlrActivity(encEvent.stamp);
+		if (encEvent.delta != 0)
+		{
+			AmpHdlrGroupStep(ampGroupMask[encEvent.dev], encEvent.delta);
+		}
+	}
+	AmpHdlrRampRun();
+	AmpHdlrSleepRun();
+	AmpHdlrRetryRun();
+
+	return result;
+}
+
+/* Knob position of a zone, beyond AMP_HDLR_VOL_POS_MAX is full volume */
+AmpHdlrErrCode AmpHdlrSetVolume (tAmpHdlrZone zone, uint8_t pos)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+	boolean isMinVolume;
+
+	if (zone < AMP_HDLR_ZONE_NUM)
+	{
+		isMinVolume = AmpHdlrIsMinVolume();
+		ampZone[zone].volPos = (pos > AMP_HDLR_VOL_POS_MAX) ? AMP_HDLR_VOL_POS_MAX : pos;
+		ampZone[zone].gainTarget = AmpHdlrVolGain(zone);
+		if ( (isMinVolume != TRUE) && (AmpHdlrIsMinVolume() == TRUE) )
+		{
+			TimerSet(&ampMinVolTmr, (int)AMP_SLEEP_MIN_VOL_MS);
+		}
+		NvmHdlrSet(NVM_HDLR_KEY_VOLUME_OF(zone), ampZone[zone].volPos);
+		result = AMP_HDLR_OK;
+	}
+
+	return result;
+}
+
+/* Zones moved by an encoder, AMP_HDLR_ZONE_BIT() of each, 0 leaves the encoder out */
+AmpHdlrErrCode AmpHdlrSetGroup (tEncHdlrDevIdx dev, uint32_t zoneMask)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+
+	if ( (dev < ENC_HDLR_DEV_NUM) && ((zoneMask & ~AMP_HDLR_ZONE_ALL) == 0u) )
+	{
+		ampGroupMask[dev] = zoneMask;
+		result = AMP_HDLR_OK;
+	}
+
+	return result;
+}
+
+/* Outputs of a zone off and on, the gain and the fault handling carry on */
+AmpHdlrErrCode AmpHdlrSetMute (tAmpHdlrZone zone, boolean isMuted)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+
+	if (zone < AMP_HDLR_ZONE_NUM)
+	{
+		ampZone[zone].isUserMuted = isMuted;
+		AmpHdlrCtrlUpdate(zone);
+		result = AMP_HDLR_OK;
+	}
+
+	return result;
+}
+
+/* The gains of all zones follow the new curve from their knob positions */
+AmpHdlrErrCode AmpHdlrSetCurve (tAmpHdlrCurve curve)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+	uint32_t z;
+
+	if (curve < AMP_HDLR_CURVE_NUM)
+	{
+		ampCurve = curve;
+		for (z = 0u; z < AMP_HDLR_ZONE_NUM; z++)
+		{
+			ampZone[z].gainTarget = AmpHdlrVolGain(z);
+		}
+		NvmHdlrSet(NVM_HDLR_KEY_CURVE, (uint32_t)ampCurve);
+		result = AMP_HDLR_OK;
+	}
+
+	return result;
+}
+
+/* Gain slew in ms per dB, 0 jumps straight to the target */
+AmpHdlrErrCode AmpHdlrSetSlew (uint32_t msPerDb)
+{
+	ampRampMsPerDb = msPerDb;
+
+	return AMP_HDLR_OK;
+}
+
+/*
+ * Written with the next device engine pass, the fixed gain follows the volume
+ * knob in the range of the profile. A gain below 0 dB goes up to it at once
+ * for a compressing profile, in the same burst as the profile. Not saved.
+ */
+AmpHdlrErrCode AmpHdlrSetAgcProfile (tAmpHdlrZone zone, const tAmpHdlrAgcProfile *profile)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+	tAmpHdlrZoneInst *inst;
+
+	if ( (zone < AMP_HDLR_ZONE_NUM) && (profile != NULL) )
+	{
+		inst = &ampZone[zone];
+		inst->agcTimeReg[0] = profile->attack & AMP_AGC_TIME_MASK;
+		inst->agcTimeReg[1] = profile->release & AMP_AGC_TIME_MASK;
+		inst->agcTimeReg[2] = profile->hold & AMP_AGC_TIME_MASK;
+		inst->agcLimitReg[0] = profile->limiter;
+		inst->agcLimitReg[1] = profile->compression;
+		inst->isNoiseGate = profile->isNoiseGate;
+		inst->volRange = ((profile->compression & AMP_AGC_RATIO_MASK) != 0u) ? AMP_VOL_RANGE_AGC : AMP_VOL_RANGE_FULL;
+		inst->gainTarget = AmpHdlrVolGain(zone);
+		if ( (inst->volRange == AMP_VOL_RANGE_AGC) && (inst->gainDb < AMP_GAIN_MIN_AGC_DB) )
+		{
+			inst->gainDb = AMP_GAIN_MIN_AGC_DB;
+			inst->gainReg = AMP_GAIN_CODE(inst->gainDb);
+		}
+		AmpHdlrCtrlUpdate(zone);
+		inst->isAgcPending = TRUE;
+		result = AMP_HDLR_OK;
+	}
+
+	return result;
+}
+
+AmpHdlrErrCode AmpHdlrSelectAgcProfile (tAmpHdlrZone zone, tAmpHdlrAgcId id)
+{
+	AmpHdlrErrCode result = AMP_HDLR_ERR;
+
+	if ( (zone < AMP_HDLR_ZONE_NUM) && (id < AMP_HDLR_AGC_NUM) )
+	{
+		ampZone[zone].agcId = id;
+		NvmHdlrSet(NVM_HDLR_KEY_AGC_OF(zone), (uint32_t)id);
+		result = AmpHdlrSetAgcProfile(zone, &ampAgcProfiles[id]);
+	}
+
+	return result;
+}
+
+boolean AmpHdlrIsAsleep (void)
+{
+	return ampIsAsleep;
+}
+
+/* Shut down, or playing with no knob touched for AMP_QUIET_MS */
+boolean AmpHdlrIsIdle (void)
+{
+	return ( (ampIsAsleep == TRUE) || isTimerExpired(ampQuietTmr) ) ? TRUE : FALSE;
+}
@@ -200,3 +200,15 @@ ComDebugHdlrErrCode UartDebugHdlrFlushRx(void)
 {
     currTransfPosrx = 0u;
 }
+
+boolean UartDebugHdlrIsTxBusy (void)
+{
+    boolean isBusy = TRUE;
+
+    if ( (fsmststx == COM_DEBUG_HDLR_TX_IDLE) && (pendJobNum == 0) )
+    {
+        isBusy = FALSE;
+    }
+
+    return isBusy;
+}
@@ -1,160 +1,351 @@
-/**
-  ******************************************************************************
-  * @file           : DebugHdlr.c
-  * @brief          : Debug Handler
-  ******************************************************************************
-  * @attention
-  *
-  * Copyright (c) 2023 EmbeddedEspresso.
-  * All rights reserved.
-  *
-  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause 
-  * license. You may not use this file except in compliance with the License. 
-  * You may obtain a copy of the License at: 
-  * opensource.org/licenses/BSD-3-Clause
-  ******************************************************************************
-  */
-
-#include "main.h"
-
-
-typedef enum
-{
-    DEBUG_HDLR_INIT = 0,
-    DEBUG_HDLR_IDLE,
-    DEBUG_HDLR_PRINT_MENU,
-    DEBUG_HDLR_PRINT_MENU_SMS,
-    DEBUG_HDLR_READ_CHOICE,
-    DEBUG_HDLR_READ_CHOICE_SMS,
-    DEBUG_HDLR_GET_SIGNAL_WAIT,
-    DEBUG_HDLR_GET_DATE_TIME_WAIT,
-    DEBUG_HDLR_READ_SMS_WAIT,
-    DEBUG_HDLR_SEND_SMS_WAIT,
-    DEBUG_HDLR_DELETE_SMS_WAIT,
-    DEBUG_HDLR_DIRECT_MODEM_DEBUG,
-    DEBUG_HDLR_ERR_STS
-
-}DebugHdlrFsmSts;
-
-static DebugHdlrFsmSts fsmsts = DEBUG_HDLR_INIT;
-static uint8_t isMenuActive = 0;
-static uint8_t dRssi, dBer;
-static uint8_t dYear, dMonth, dDay, dHour, dMin, dSec;
-static uint8_t dDirectByte;
-static char gMsg[256];
-static char gNum[32];
-static char debugLocalStr[256];
-static char menuString[] = "\r\n\r\n1) Get modem signal level\r\n2) Get date time\r\n3) SMS handling\r\n4) Do a call\r\n5) Direct modem debug\r\n6) Restart Application\r\n7) Quit menu\r\n\r\n";
-
-DebugHdlrErrCode DebugHdlrInit (void)
-{
-    fsmsts = DEBUG_HDLR_INIT;
-}
-
-DebugHdlrErrCode DebugHdlrRun (void)
-{
-    DebugHdlrErrCode result = DEBUG_HDLR_OK;
-    static int tmr;
-    uint32_t ansIdx;
-    uint8_t readByte;
-
-    switch (fsmsts)
-    {
-        case DEBUG_HDLR_INIT:
-            PRINT_DEBUG("[Debug]: Initialization completed\r\n");
-            fsmsts = DEBUG_HDLR_IDLE;
-            break;
-
-        case DEBUG_HDLR_IDLE:
-            /* Check the input buffer */
-            if (UartDebugHdlrRx(&readByte, 1) == COM_DEBUG_HDLR_OK)
-            {
-                if (readByte == 'm')
-                {
-                    isMenuActive = 1;
-                    fsmsts = DEBUG_HDLR_PRINT_MENU;
-                }
-                UartDebugHdlrFlushRx();
-            }
-
-            break;
-
-        case DEBUG_HDLR_PRINT_MENU:
-            UartDebugHdlrTx(menuString, strlen(menuString));
-            fsmsts = DEBUG_HDLR_READ_CHOICE;
-            break;
-
-        case DEBUG_HDLR_READ_CHOICE:
-            if (UartDebugHdlrRx(&readByte, 1) == COM_DEBUG_HDLR_OK)
-            {
-                switch(readByte)
-                {
-                case '1':
-                    if (1)
-                    {
-                        UartDebugHdlrTx("Command accepted\r\n", 18);
-                        fsmsts = DEBUG_HDLR_GET_SIGNAL_WAIT;
-                    }
-                    else
-                    {
-                        UartDebugHdlrTx("Command rejected\r\n", 18);
-                        fsmsts = DEBUG_HDLR_PRINT_MENU;
-                    }
-                    break;
-
-                case '2':
-                    if (1)
-                    {
-                        UartDebugHdlrTx("Command accepted\r\n", 18);
-                        fsmsts = DEBUG_HDLR_GET_DATE_TIME_WAIT;
-                    }
-                    else
-                    {
-                        UartDebugHdlrTx("Command rejected\r\n", 18);
-                        fsmsts = DEBUG_HDLR_PRINT_MENU;
-                    }
-                    break;
-
-                case '3':
-                    fsmsts = DEBUG_HDLR_PRINT_MENU_SMS;
-                    break;
-
-                case '5':
-                    UartDebugHdlrTx("Direct modem mode started ('q' for quit)\r\n\r\n", 44);
-                    fsmsts = DEBUG_HDLR_DIRECT_MODEM_DEBUG;
-                    break;
-
-                case '6':
-                    NVIC_SystemReset();
-                    break;
-
-                case '7':
-                    isMenuActive = 0;
-                    fsmsts = DEBUG_HDLR_IDLE;
-                    break;
-
-                default:
-                    fsmsts = DEBUG_HDLR_PRINT_MENU;
-                    break;
-                }
-                UartDebugHdlrFlushRx();
-            }
-
-            break;
-
-
-        case DEBUG_HDLR_ERR_STS:
-            break;
-
-    }
-
-    return result;
-}
-
-DebugHdlrErrCode DebugHdlrPrintMsg(uint8_t *buff)
-{
-    if (isMenuActive == 0)
-    {
-        return UartDebugHdlrTx(buff, strlen(buff));
-    }
-}
+/**
+  ******************************************************************************
+  * @file           : DebugHdlr.c
+  * @brief          : Debug Handler
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause 
+  * license. You may not use this file except in compliance with the License. 
+  * You may obtain a copy of the License at: 
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+#ifdef I2C_HDLR_SIM
+#define DEBUG_HDLR_SIM_MENU "a) I2c simulated bus benchmark\r\n"
+#else
+#define DEBUG_HDLR_SIM_MENU ""
+#endif
+
+/*
+ * Longest I2c statistics report, every counter at 10 digits: the summary line,
+ * the latency title, every histogram bucket (" 2^31:" and the count) and the
+ * line end, for each bus.
+ */
+#define DEBUG_HDLR_I2C_LINE_MAX 203u
+#define DEBUG_HDLR_I2C_HIST_TITLE_MAX 19u
+#define DEBUG_HDLR_I2C_BUCKET_MAX 16u
+#define DEBUG_HDLR_I2C_STATS_LEN ((I2C_HDLR_MOD_NUM * (DEBUG_HDLR_I2C_LINE_MAX + DEBUG_HDLR_I2C_HIST_TITLE_MAX + \
+                                    (I2C_HDLR_LAT_HIST_LEN * DEBUG_HDLR_I2C_BUCKET_MAX) + 2u)) + 1u)
+
+typedef enum
+{
+    DEBUG_HDLR_INIT = 0,
+    DEBUG_HDLR_IDLE,
+    DEBUG_HDLR_PRINT_MENU,
+    DEBUG_HDLR_PRINT_MENU_SMS,
+    DEBUG_HDLR_READ_CHOICE,
+    DEBUG_HDLR_READ_CHOICE_SMS,
+    DEBUG_HDLR_GET_SIGNAL_WAIT,
+    DEBUG_HDLR_GET_DATE_TIME_WAIT,
+    DEBUG_HDLR_READ_SMS_WAIT,
+    DEBUG_HDLR_SEND_SMS_WAIT,
+    DEBUG_HDLR_DELETE_SMS_WAIT,
+    DEBUG_HDLR_DIRECT_MODEM_DEBUG,
+    DEBUG_HDLR_ERR_STS
+
+}DebugHdlrFsmSts;
+
+static DebugHdlrFsmSts fsmsts = DEBUG_HDLR_INIT;
+static uint8_t isMenuActive = 0;
+static uint8_t dRssi, dBer;
+static uint8_t dYear, dMonth, dDay, dHour, dMin, dSec;
+static uint8_t dDirectByte;
+static char gMsg[256];
+static char gNum[32];
+static char debugLocalStr[256];
+static char menuString[] = "\r\n\r\n1) Get modem signal level\r\n2) Get date time\r\n3) SMS handling\r\n4) Do a call\r\n5) Direct modem debug\r\n6) Restart Application\r\n7) Quit menu\r\n8) I2c backend benchmark\r\n9) I2c bus statistics\r\n" DEBUG_HDLR_SIM_MENU "b) Next AGC profile, all zones\r\nc) Power state residency\r\nd) Settings store usage\r\ne) Next I2c1 speed\r\n\r\n";
+static char i2cStatsStr[DEBUG_HDLR_I2C_STATS_LEN];
+static char pwrStatsStr[256];
+static char nvmStatsStr[128];
+static tAmpHdlrAgcId agcProfile = AMP_HDLR_AGC_FLAT;
+
+static void DebugHdlrPrintI2cStats (void);
+static void DebugHdlrPrintPwrStats (void);
+static void DebugHdlrPrintNvmStats (void);
+
+DebugHdlrErrCode DebugHdlrInit (void)
+{
+    fsmsts = DEBUG_HDLR_INIT;
+}
+
+DebugHdlrErrCode DebugHdlrRun (void)
+{
+    DebugHdlrErrCode result = DEBUG_HDLR_OK;
+    static int tmr;
+    uint32_t ansIdx;
+    uint32_t zone;
+    tI2cHdlrSpeed speed;
+    uint8_t readByte;
+
+    switch (fsmsts)
+    {
+        case DEBUG_HDLR_INIT:
+            PRINT_DEBUG("[Debug]: Initialization completed\r\n");
+            fsmsts = DEBUG_HDLR_IDLE;
+            break;
+
+        case DEBUG_HDLR_IDLE:
+            /* Check the input buffer */
+            if (UartDebugHdlrRx(&readByte, 1) == COM_DEBUG_HDLR_OK)
+            {
+                if (readByte == 'm')
+                {
+                    isMenuActive = 1;
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                }
+                UartDebugHdlrFlushRx();
+            }
+
+            break;
+
+        case DEBUG_HDLR_PRINT_MENU:
+            UartDebugHdlrTx(menuString, strlen(menuString));
+            fsmsts = DEBUG_HDLR_READ_CHOICE;
+            break;
+
+        case DEBUG_HDLR_READ_CHOICE:
+            if (UartDebugHdlrRx(&readByte, 1) == COM_DEBUG_HDLR_OK)
+            {
+                switch(readByte)
+                {
+                case '1':
+                    if (1)
+                    {
+                        UartDebugHdlrTx("Command accepted\r\n", 18);
+                        fsmsts = DEBUG_HDLR_GET_SIGNAL_WAIT;
+                    }
+                    else
+                    {
+                        UartDebugHdlrTx("Command rejected\r\n", 18);
+                        fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    }
+                    break;
+
+                case '2':
+                    if (1)
+                    {
+                        UartDebugHdlrTx("Command accepted\r\n", 18);
+                        fsmsts = DEBUG_HDLR_GET_DATE_TIME_WAIT;
+                    }
+                    else
+                    {
+                        UartDebugHdlrTx("Command rejected\r\n", 18);
+                        fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    }
+                    break;
+
+                case '3':
+                    fsmsts = DEBUG_HDLR_PRINT_MENU_SMS;
+                    break;
+
+                case '5':
+                    UartDebugHdlrTx("Direct modem mode started ('q' for quit)\r\n\r\n", 44);
+                    fsmsts = DEBUG_HDLR_DIRECT_MODEM_DEBUG;
+                    break;
+
+                case '6':
+                    NVIC_SystemReset();
+                    break;
+
+                case '7':
+                    isMenuActive = 0;
+                    fsmsts = DEBUG_HDLR_IDLE;
+                    break;
+
+                case '8':
+                    /* Encoder bus, counter register */
+                    if (I2cBenchStart(I2C_HDLR_MOD1, 0x8E, 0x08) == I2C_BENCH_OK)
+                    {
+                        UartDebugHdlrTx("Command accepted\r\n", 18);
+                    }
+                    else
+                    {
+                        UartDebugHdlrTx("Command rejected\r\n", 18);
+                    }
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+                case 'e':
+                    /* Benchmark bus, standard and fast mode timings, applied once the bus is idle */
+                    speed = I2cHdlrGetSpeed(I2C_HDLR_MOD1);
+                    speed = (speed >= I2C_HDLR_SPEED_400K_DUTY169) ? I2C_HDLR_SPEED_100K : (tI2cHdlrSpeed)(speed + 1u);
+                    if (I2cHdlrSetSpeed(I2C_HDLR_MOD1, speed) == I2C_HDLR_OK)
+                    {
+                        UartDebugHdlrTx("Command accepted\r\n", 18);
+                    }
+                    else
+                    {
+                        UartDebugHdlrTx("Command rejected\r\n", 18);
+                    }
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+#ifdef I2C_HDLR_SIM
+                case 'a':
+                    /* Model memory, read back from address 0 */
+                    if (I2cBenchStartPolled(I2C_SIM_BUS, I2C_SIM_DEV_ADDR, 0x00) == I2C_BENCH_OK)
+                    {
+                        UartDebugHdlrTx("Command accepted\r\n", 18);
+                    }
+                    else
+                    {
+                        UartDebugHdlrTx("Command rejected\r\n", 18);
+                    }
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+#endif
+
+                case '9':
+                    DebugHdlrPrintI2cStats();
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+                case 'b':
+                    agcProfile = (tAmpHdlrAgcId)((agcProfile + 1u) % AMP_HDLR_AGC_NUM);
+                    for (zone = 0u; zone < AMP_HDLR_ZONE_NUM; zone++)
+                    {
+                        AmpHdlrSelectAgcProfile((tAmpHdlrZone)zone, agcProfile);
+                    }
+                    UartDebugHdlrTx("Command accepted\r\n", 18);
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+                case 'c':
+                    DebugHdlrPrintPwrStats();
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+                case 'd':
+                    DebugHdlrPrintNvmStats();
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+
+                default:
+                    fsmsts = DEBUG_HDLR_PRINT_MENU;
+                    break;
+                }
+                UartDebugHdlrFlushRx();
+            }
+
+            break;
+
+
+        case DEBUG_HDLR_ERR_STS:
+            break;
+
+    }
+
+    return result;
+}
+
+/* Counters are cleared on every print, each report covers the time since the previous one */
+static void DebugHdlrPrintI2cStats (void)
+{
+    tI2cHdlrStats stats;
+    uint32_t idx;
+    uint32_t bucket;
+    uint32_t len = 0u;
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000u;
+    uint32_t utilPm;
+
+    for (idx = 0u; idx < I2C_HDLR_MOD_NUM; idx++)
+    {
+        if (i2cHdlrBusCfg[idx].isEnabled != TRUE)
+        {
+            continue;
+        }
+
+        I2cHdlrGetStats(idx, &stats, TRUE);
+        utilPm = 0u;
+        if (stats.windowCycles != 0u)
+        {
+            utilPm = (uint32_t)((stats.busyCycles * 1000u) / stats.windowCycles);
+        }
+
+        len += sprintf(&i2cStatsStr[len], "\r\nI2C%u: %u tr, %u bytes, %u nack, %u err, %u retry, %u recovery, busy %u us of %u ms (%u.%u%%), max %u us\r\n",
+                       (unsigned int)(idx + 1u),
+                       (unsigned int)stats.trCnt,
+                       (unsigned int)stats.byteCnt,
+                       (unsigned int)stats.nackCnt,
+                       (unsigned int)stats.errCnt,
+                       (unsigned int)stats.retryCnt,
+                       (unsigned int)I2cHdlrGetRecoveryCount(idx),
+                       (unsigned int)(stats.busyCycles / cyclesPerUs),
+                       (unsigned int)(stats.windowCycles / (cyclesPerUs * 1000u)),
+                       (unsigned int)(utilPm / 10u), (unsigned int)(utilPm % 10u),
+                       (unsigned int)(stats.latencyMax / cyclesPerUs));
+        len += sprintf(&i2cStatsStr[len], "  latency (cycles):");
+        for (bucket = 0u; bucket < I2C_HDLR_LAT_HIST_LEN; bucket++)
+        {
+            if (stats.latencyHist[bucket] != 0u)
+            {
+                len += sprintf(&i2cStatsStr[len], " 2^%u:%u", (unsigned int)bucket, (unsigned int)stats.latencyHist[bucket]);
+            }
+        }
+        len += sprintf(&i2cStatsStr[len], "\r\n");
+    }
+
+    UartDebugHdlrTx(i2cStatsStr, len);
+}
+
+static void DebugHdlrPrintPwrStats (void)
+{
+    tPwrHdlrStats stats;
+    uint32_t len;
+    uint32_t awakeMs;
+    uint32_t sleepPm = 0u;
+
+    PwrHdlrGetStats(&stats, TRUE);
+    awakeMs = (uint32_t)(stats.awakeCycles / (SystemCoreClock / 1000u));
+    if (stats.stateMs[PWR_HDLR_STANDBY] > awakeMs)
+    {
+        sleepPm = (uint32_t)(((uint64_t)(stats.stateMs[PWR_HDLR_STANDBY] - awakeMs) * 1000u) / stats.stateMs[PWR_HDLR_STANDBY]);
+    }
+
+    len = sprintf(pwrStatsStr, "\r\nActive %u ms, standby %u ms (core asleep %u.%u%%, %u waits), %u wake ups, max wake %u us\r\n",
+                  (unsigned int)stats.stateMs[PWR_HDLR_ACTIVE],
+                  (unsigned int)stats.stateMs[PWR_HDLR_STANDBY],
+                  (unsigned int)(sleepPm / 10u), (unsigned int)(sleepPm % 10u),
+                  (unsigned int)stats.sleepCnt,
+                  (unsigned int)stats.wakeCnt,
+                  (unsigned int)(stats.wakeLatencyMax / (SystemCoreClock / 1000000u)));
+
+    UartDebugHdlrTx(pwrStatsStr, len);
+}
+
+static void DebugHdlrPrintNvmStats (void)
+{
+    tNvmHdlrStats stats;
+    uint32_t len;
+
+    NvmHdlrGetStats(&stats);
+    len = sprintf(nvmStatsStr, "\r\nRecords %u used, %u free, %u written, %u compactions, %u errors\r\n",
+                  (unsigned int)stats.used,
+                  (unsigned int)stats.free,
+                  (unsigned int)stats.appendCnt,
+                  (unsigned int)stats.compactCnt,
+                  (unsigned int)stats.errCnt);
+
+    UartDebugHdlrTx(nvmStatsStr, len);
+}
+
+DebugHdlrErrCode DebugHdlrPrintMsg(const char *buff)
+{
+    DebugHdlrErrCode result = DEBUG_HDLR_BUSY;
+
+    if (isMenuActive == 0)
+    {
+        result = (DebugHdlrErrCode)UartDebugHdlrTx((uint8_t *)buff, strlen(buff));
+    }
+
+    return result;
+}
@@ -0,0 +1,450 @@
+/**
+  ******************************************************************************
+  * @file           : DevHdlr.c
+  * @brief          : I2c device engine
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Common life cycle of the I2c devices: the init table goes out as merged
+ * bursts, then each device serves its periodic reads and on-change writes
+ * from its descriptor. The handlers only keep their application logic.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+/* Init table or writes sent again after a failure, the delay doubles up to the max shift */
+#define DEV_HDLR_BACKOFF_MS 100u
+#define DEV_HDLR_BACKOFF_SHIFT_MAX 6u
+
+typedef enum
+{
+    DEV_HDLR_CFG = 0,
+	DEV_HDLR_CFG_WAIT,
+	/* Init table failed, nothing else is served until it goes through */
+	DEV_HDLR_CFG_RETRY,
+	DEV_HDLR_READY
+} tDevHdlrFsmSts;
+
+typedef struct
+{
+	/* Register address sent from RAM */
+	uint8_t reg;
+	uint8_t data[I2C_HDLR_REG_CFG_MAX];
+	volatile tI2cHdlrTrStatus status;
+	boolean isBusy;
+	boolean isRequested;
+	/* From the descriptor, DevHdlrSetPeriod() may change it */
+	uint32_t period;
+	int tmr;
+} tDevHdlrReadSts;
+
+typedef struct
+{
+	const tDevHdlrDesc *desc;
+	tDevHdlrFsmSts fsmsts;
+	uint8_t cfgBuff[I2C_HDLR_CFG_BUFF_LEN(DEV_HDLR_CFG_MAX)];
+	tI2cHdlrBurst cfgBurst[DEV_HDLR_CFG_MAX];
+	uint32_t cfgBurstNum;
+	volatile tI2cHdlrTrStatus cfgStatus;
+	uint32_t cfgRetryCnt;
+	int cfgTmr;
+	tDevHdlrReadSts read[DEV_HDLR_READ_MAX];
+	/* Last value handed to the bus per write, and the writes of the batch on the bus */
+	uint8_t wrSent[DEV_HDLR_WRITE_MAX][I2C_HDLR_REG_CFG_MAX];
+	uint32_t wrBusyMap;
+	/* Writes of a failed batch, sent again whatever their value once wrTmr expires */
+	uint32_t wrStaleMap;
+	uint32_t wrRetryCnt;
+	int wrTmr;
+	uint8_t wrBuff[I2C_HDLR_CFG_BUFF_LEN(DEV_HDLR_WRITE_MAX)];
+	tI2cHdlrBurst wrBurst[DEV_HDLR_WRITE_MAX];
+	volatile tI2cHdlrTrStatus wrStatus;
+} tDevHdlrInstance;
+
+static tDevHdlrInstance devHdlrInst[DEV_HDLR_DEV_MAX];
+static uint32_t devHdlrNum;
+static char debugLocalStr[128];
+
+static void DevHdlrReadRun (uint32_t dev)
+{
+	tDevHdlrInstance *inst = &devHdlrInst[dev];
+	const tDevHdlrDesc *desc = inst->desc;
+	const tDevHdlrRead *rdDesc;
+	tDevHdlrReadSts *rd;
+	uint32_t item;
+
+	for (item = 0u; item < desc->readNum; item++)
+	{
+		rdDesc = &desc->reads[item];
+		rd = &inst->read[item];
+		if (rd->isBusy == TRUE)
+		{
+			if (rd->status != I2C_HDLR_TR_PENDING)
+			{
+				rd->isBusy = FALSE;
+				if (rd->period != 0u)
+				{
+					/* Next deadline from the previous one, no drift unless a whole period late */
+					rd->tmr += (int)rd->period;
+					if (isTimerExpired(rd->tmr))
+					{
+						TimerSet(&rd->tmr, (int)rd->period);
+					}
+				}
+				if (rdDesc->callback != NULL)
+				{
+					rdDesc->callback(dev, rd->data, rd->status);
+				}
+			}
+		}
+		else if ( (rd->isRequested == TRUE) || ((rd->period != 0u) && isTimerExpired(rd->tmr)) )
+		{
+			if (I2cHdlrRegRead(desc->i2cIdx, desc->addr, &rd->reg, rd->data, rdDesc->length, &rd->status) == I2C_HDLR_OK)
+			{
+				rd->isRequested = FALSE;
+				rd->isBusy = TRUE;
+			}
+		}
+	}
+}
+
+/*
+ * Unchanged items lying between two changed ones on contiguous registers are
+ * sent again with them, one burst costs less than two.
+ */
+static uint32_t DevHdlrWriteBridge (const tDevHdlrDesc *desc, uint32_t map)
+{
+	uint32_t result = map;
+	uint32_t first = 0u;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t item;
+	uint32_t idx;
+
+	for (item = 1u; item <= desc->writeNum; item++)
+	{
+		if ( (item == desc->writeNum) ||
+			 (desc->writes[item].reg != (desc->writes[item - 1u].reg + desc->writes[item - 1u].length)) )
+		{
+			/* End of the run first..item-1 */
+			lo = item;
+			hi = first;
+			for (idx = first; idx < item; idx++)
+			{
+				if ((map & (1u << idx)) != 0u)
+				{
+					lo = (lo == item) ? idx : lo;
+					hi = idx;
+				}
+			}
+			for (idx = lo; idx < hi; idx++)
+			{
+				result |= (1u << idx);
+			}
+			first = item;
+		}
+	}
+
+	return result;
+}
+
+static void DevHdlrWriteRun (uint32_t dev)
+{
+	tDevHdlrInstance *inst = &devHdlrInst[dev];
+	const tDevHdlrDesc *desc = inst->desc;
+	const tDevHdlrWrite *wrDesc;
+	tI2cHdlrRegCfg rows[DEV_HDLR_WRITE_MAX];
+	uint32_t rowNum = 0u;
+	uint32_t map = 0u;
+	uint32_t burstNum;
+	uint32_t item;
+	uint32_t idx;
+	boolean isChanged;
+
+	if (inst->wrBusyMap != 0u)
+	{
+		if (inst->wrStatus != I2C_HDLR_TR_PENDING)
+		{
+			if (inst->wrStatus != I2C_HDLR_TR_OK)
+			{
+				/* wrSent no longer tells what the device holds, no batch before the backoff */
+				inst->wrStaleMap |= inst->wrBusyMap;
+				TimerSet(&inst->wrTmr, (int)(DEV_HDLR_BACKOFF_MS << inst->wrRetryCnt));
+				if (inst->wrRetryCnt < DEV_HDLR_BACKOFF_SHIFT_MAX)
+				{
+					inst->wrRetryCnt++;
+				}
+			}
+			else
+			{
+				inst->wrRetryCnt = 0u;
+			}
+			for (item = 0u; item < desc->writeNum; item++)
+			{
+				if ( ((inst->wrBusyMap & (1u << item)) != 0u) && (desc->writes[item].callback != NULL) )
+				{
+					desc->writes[item].callback(dev, inst->wrStatus);
+				}
+			}
+			inst->wrBusyMap = 0u;
+		}
+	}
+	else if ( (inst->wrRetryCnt == 0u) || isTimerExpired(inst->wrTmr) )
+	{
+		/* Everything changed since the last batch, latest value only */
+		for (item = 0u; item < desc->writeNum; item++)
+		{
+			wrDesc = &desc->writes[item];
+			isChanged = ((inst->wrStaleMap & (1u << item)) != 0u) ? TRUE : FALSE;
+			for (idx = 0u; idx < wrDesc->length; idx++)
+			{
+				if (wrDesc->pValue[idx] != inst->wrSent[item][idx])
+				{
+					isChanged = TRUE;
+				}
+			}
+			if (isChanged == TRUE)
+			{
+				map |= (1u << item);
+			}
+		}
+
+		map = DevHdlrWriteBridge(desc, map);
+		for (item = 0u; item < desc->writeNum; item++)
+		{
+			if ((map & (1u << item)) != 0u)
+			{
+				wrDesc = &desc->writes[item];
+				rows[rowNum].reg = wrDesc->reg;
+				rows[rowNum].length = wrDesc->length;
+				memcpy(rows[rowNum].value, wrDesc->pValue, wrDesc->length);
+				rowNum++;
+			}
+		}
+
+		if (rowNum != 0u)
+		{
+			burstNum = I2cHdlrCfgMerge(rows, rowNum, inst->wrBuff, inst->wrBurst);
+			if (I2cHdlrCfgLoad(desc->i2cIdx, desc->addr, inst->wrBurst, burstNum, &inst->wrStatus) == I2C_HDLR_OK)
+			{
+				rowNum = 0u;
+				for (item = 0u; item < desc->writeNum; item++)
+				{
+					if ((map & (1u << item)) != 0u)
+					{
+						memcpy(inst->wrSent[item], rows[rowNum].value, rows[rowNum].length);
+						rowNum++;
+					}
+				}
+				inst->wrBusyMap = map;
+				inst->wrStaleMap &= ~map;
+			}
+		}
+	}
+}
+
+static void DevHdlrDevRun (uint32_t dev)
+{
+	tDevHdlrInstance *inst = &devHdlrInst[dev];
+	const tDevHdlrDesc *desc = inst->desc;
+	uint32_t item;
+
+	switch (inst->fsmsts)
+	{
+		case DEV_HDLR_CFG:
+			/* The whole table is queued at once, the last burst reports completion */
+			if (I2cHdlrCfgLoad(desc->i2cIdx, desc->addr, inst->cfgBurst, inst->cfgBurstNum, &inst->cfgStatus) == I2C_HDLR_OK)
+			{
+				inst->fsmsts = DEV_HDLR_CFG_WAIT;
+			}
+			break;
+
+		case DEV_HDLR_CFG_WAIT:
+			if (inst->cfgStatus == I2C_HDLR_TR_PENDING)
+			{
+				/* Wait */
+			}
+			else if (inst->cfgStatus != I2C_HDLR_TR_OK)
+			{
+				/* Device absent or not powered yet, the whole table goes again */
+				TimerSet(&inst->cfgTmr, (int)(DEV_HDLR_BACKOFF_MS << inst->cfgRetryCnt));
+				sprintf(debugLocalStr, "[%s]: Configuration failed (%d), retry in %u ms\r\n", desc->name,
+						inst->cfgStatus, (unsigned int)(DEV_HDLR_BACKOFF_MS << inst->cfgRetryCnt));
+				PRINT_DEBUG(debugLocalStr);
+				if (inst->cfgRetryCnt < DEV_HDLR_BACKOFF_SHIFT_MAX)
+				{
+					inst->cfgRetryCnt++;
+				}
+				inst->fsmsts = DEV_HDLR_CFG_RETRY;
+			}
+			else
+			{
+				sprintf(debugLocalStr, "[%s]: Initialization completed\r\n", desc->name);
+				PRINT_DEBUG(debugLocalStr);
+				inst->cfgRetryCnt = 0u;
+				for (item = 0u; item < desc->readNum; item++)
+				{
+					TimerSet(&inst->read[item].tmr, (int)inst->read[item].period);
+				}
+				inst->fsmsts = DEV_HDLR_READY;
+			}
+			break;
+
+		case DEV_HDLR_CFG_RETRY:
+			if (isTimerExpired(inst->cfgTmr))
+			{
+				inst->fsmsts = DEV_HDLR_CFG;
+			}
+			break;
+
+		case DEV_HDLR_READY:
+			DevHdlrWriteRun(dev);
+			DevHdlrReadRun(dev);
+			break;
+
+	}
+}
+
+void DevHdlrInit (void)
+{
+	devHdlrNum = 0u;
+}
+
+void DevHdlrRun (void)
+{
+	uint32_t dev;
+
+	for (dev = 0u; dev < devHdlrNum; dev++)
+	{
+		DevHdlrDevRun(dev);
+	}
+}
+
+/* After I2cHdlrInit(), the device starts its init table on the next DevHdlrRun() */
+DevHdlrErrCode DevHdlrAttach (const tDevHdlrDesc *desc, uint32_t *pDev)
+{
+	DevHdlrErrCode result = DEV_HDLR_ERR;
+	tDevHdlrInstance *inst;
+	boolean isLengthOk = TRUE;
+	uint32_t item;
+
+	/* Every row and item has to fit a register row */
+	for (item = 0u; (item < desc->initNum) && (item < DEV_HDLR_CFG_MAX); item++)
+	{
+		if (desc->init[item].length > I2C_HDLR_REG_CFG_MAX)
+		{
+			isLengthOk = FALSE;
+		}
+	}
+	for (item = 0u; (item < desc->readNum) && (item < DEV_HDLR_READ_MAX); item++)
+	{
+		if ( (desc->reads[item].length == 0u) || (desc->reads[item].length > I2C_HDLR_REG_CFG_MAX) )
+		{
+			isLengthOk = FALSE;
+		}
+	}
+	for (item = 0u; (item < desc->writeNum) && (item < DEV_HDLR_WRITE_MAX); item++)
+	{
+		if ( (desc->writes[item].length == 0u) || (desc->writes[item].length > I2C_HDLR_REG_CFG_MAX) )
+		{
+			isLengthOk = FALSE;
+		}
+	}
+
+	if ( (devHdlrNum < DEV_HDLR_DEV_MAX) && (desc->initNum <= DEV_HDLR_CFG_MAX) &&
+		 (desc->readNum <= DEV_HDLR_READ_MAX) && (desc->writeNum <= DEV_HDLR_WRITE_MAX) && (isLengthOk == TRUE) )
+	{
+		inst = &devHdlrInst[devHdlrNum];
+		inst->desc = desc;
+		inst->cfgBurstNum = I2cHdlrCfgMerge(desc->init, desc->initNum, inst->cfgBuff, inst->cfgBurst);
+		for (item = 0u; item < desc->readNum; item++)
+		{
+			inst->read[item].reg = desc->reads[item].reg;
+			inst->read[item].period = desc->reads[item].period;
+			inst->read[item].isBusy = FALSE;
+			inst->read[item].isRequested = FALSE;
+		}
+		for (item = 0u; item < desc->writeNum; item++)
+		{
+			memcpy(inst->wrSent[item], desc->writes[item].pValue, desc->writes[item].length);
+		}
+		inst->wrBusyMap = 0u;
+		inst->wrStaleMap = 0u;
+		inst->wrRetryCnt = 0u;
+		inst->cfgRetryCnt = 0u;
+		if (desc->shadow != NULL)
+		{
+			I2cHdlrShadowAttach(desc->i2cIdx, desc->shadow);
+		}
+		inst->fsmsts = DEV_HDLR_CFG;
+		*pDev = devHdlrNum;
+		devHdlrNum++;
+		result = DEV_HDLR_OK;
+	}
+
+	return result;
+}
+
+boolean DevHdlrIsReady (uint32_t dev)
+{
+	boolean result = FALSE;
+
+	if ( (dev < devHdlrNum) && (devHdlrInst[dev].fsmsts == DEV_HDLR_READY) )
+	{
+		result = TRUE;
+	}
+
+	return result;
+}
+
+/* One shot read of a table item, also ahead of time for a periodic one */
+DevHdlrErrCode DevHdlrReadRequest (uint32_t dev, uint32_t item)
+{
+	DevHdlrErrCode result = DEV_HDLR_ERR;
+
+	if ( (dev < devHdlrNum) && (item < devHdlrInst[dev].desc->readNum) )
+	{
+		devHdlrInst[dev].read[item].isRequested = TRUE;
+		result = DEV_HDLR_OK;
+	}
+
+	return result;
+}
+
+/*
+ * New period of a read item, 0 to stop it. The next read comes no later than
+ * one new period from now, an earlier deadline already set is kept.
+ */
+DevHdlrErrCode DevHdlrSetPeriod (uint32_t dev, uint32_t item, uint32_t period)
+{
+	DevHdlrErrCode result = DEV_HDLR_ERR;
+	tDevHdlrReadSts *rd;
+	int tmr;
+
+	if ( (dev < devHdlrNum) && (item < devHdlrInst[dev].desc->readNum) )
+	{
+		rd = &devHdlrInst[dev].read[item];
+		TimerSet(&tmr, (int)period);
+		if ( (rd->period == 0u) || ((tmr - rd->tmr) < 0) )
+		{
+			rd->tmr = tmr;
+		}
+		rd->period = period;
+		result = DEV_HDLR_OK;
+	}
+
+	return result;
+}
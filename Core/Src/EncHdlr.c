@@ -14,174 +14,538 @@
   * opensource.org/licenses/BSD-3-Clause
   ******************************************************************************
   */
-
+#include <stdio.h>
 #include "main.h"
 
+#define ENC_REG_NUM 0x34u
 #define ENC_CFG_LENGTH 6u
+#define ENC_ESTATUS_REG 0x05u
+#define ENC_CVAL_REG 0x08u
+#define ENC_CVAL_LENGTH 4u
+/* ESTATUS, I2STATUS, FSTATUS and CVAL (MSB first) in one read from 0x05 */
+#define ENC_EVENT_LENGTH 7u
+#define ENC_EVENT_CVAL_OFFS 3u
+/* ESTATUS bits that come with a new counter value */
+#define ENC_HDLR_ST_MOVED (ENC_HDLR_ST_RINC | ENC_HDLR_ST_RDEC | ENC_HDLR_ST_RMAX | ENC_HDLR_ST_RMIN)
+/* Counter as written by encRegConf */
+#define ENC_CVAL_DEFAULT 6
+/* 32 bit register value, MSB first */
+#define ENC_REG32(v) {(uint8_t)((v) >> 24), (uint8_t)((v) >> 16), (uint8_t)((v) >> 8), (uint8_t)(v)}
+/* Velocity is the number of detents seen over the last window */
+#define ENC_VEL_WINDOW_MS 250u
+#define ENC_VEL_HIST_LEN 8u
+#define ENC_ISTEP_REG 0x14u
+/* Event ring, power of 2 */
+#define ENC_EVENT_RING_LEN 16u
+/* Below the I2c interrupts, the latch only needs to be taken before the next edge */
+#define ENC_INT_IRQ_PRIO 6u
 
 typedef enum
 {
     ENC_HDLR_INIT = 0,
-	ENC_HDLR_CFG,
-	ENC_HDLR_CFG_WAIT,
 	ENC_HDLR_PREIDLE,
 	ENC_HDLR_IDLE,
-	ENC_HDLR_GETSTSTX,
-	ENC_HDLR_GETSTSTX_WAIT,
-	ENC_HDLR_GETSTSRX,
-	ENC_HDLR_GETSTSRX_WAIT,
-	ENC_HDLR_GETPOSTX,
-	ENC_HDLR_GETPOSTX_WAIT,
-	ENC_HDLR_GETPOSRX,
-	ENC_HDLR_GETPOSRX_WAIT
+	ENC_HDLR_GETSTATUS,
+	ENC_HDLR_GETSTATUS_WAIT,
+	ENC_HDLR_GETPOS,
+	ENC_HDLR_GETPOS_WAIT
 } tEncHdlrFsmSts;
 
 typedef struct
 {
-	uint8_t cnf[5];
-	uint32_t length;
-}tEncHdlrCfg;
+	tI2cHdlrShadow shadow;
+	uint8_t shadowValue[ENC_REG_NUM];
+	uint8_t shadowValid[I2C_HDLR_SHADOW_MAP_LEN(ENC_REG_NUM)];
+	/* ESTATUS..CVAL as read from 0x05, or ESTATUS and CVAL read separately */
+	uint8_t dataReg[ENC_EVENT_LENGTH];
+	/* Init table with the start counter in CVAL */
+	tI2cHdlrRegCfg regConf[ENC_CFG_LENGTH];
+	boolean isFullRead;
+	volatile tI2cHdlrTrStatus readStatus;
+	tEncHdlrEvent lastEvent;
+	/* Device engine index */
+	uint32_t engDev;
+	boolean isPressed;
+	int32_t prevValue;
+	/* Counter step, and ISTEP (MSB first) written by the engine when it changes */
+	uint32_t step;
+	uint8_t stepReg[4];
+	const tEncHdlrAccel *accelCurve;
+	uint32_t accelLength;
+	uint32_t velStamp[ENC_VEL_HIST_LEN];
+	uint32_t velDetents[ENC_VEL_HIST_LEN];
+	uint32_t velIdx;
+} tEncHdlrInstance;
+
+typedef struct
+{
+	boolean isEnabled;
+	/* Copied to the instance init table by EncHdlrInit */
+	const tI2cHdlrRegCfg *regConf;
+	tDevHdlrDesc desc;
+} tEncHdlrDevCfg;
 
 static tEncHdlrFsmSts fsmsts;
-static uint16_t devAddress = 0x8E;
-/* Provide a configuration struct */
-/* Improvement: Use the INT pin to trigger encoder read */
-
-static uint8_t encValConfRegAddr = 0x0C;
-static tEncHdlrCfg encRegConf[ENC_CFG_LENGTH] = { { {0x04u, 0x18u}, 0x02u },
-												  { {0x08u, 0x00u, 0x00u, 0x00u, 0x06u}, 0x05u },
-												  { {0x0Cu, 0x00u, 0x00u, 0x00u, 0x10u}, 0x05u },
-											      { {0x10u, 0x00u, 0x00u, 0x00u, 0x00u}, 0x05u },
-											      { {0x14u, 0x00u, 0x00u, 0x00u, 0x01u}, 0x05u },
-											      { {0x30u, 0x00u, 0x00u, 0x00u, 0x01u}, 0x05u },
-												};
-
-static uint8_t encValPosRegAddr = 0x08;
-static uint8_t encStsPosRegAddr = 0x05;
-static uint8_t dataReg[4] = {0};
+static tEncHdlrInstance encInst[ENC_HDLR_DEV_NUM];
+/* Counter loaded at attach, EncHdlrSetStartValue may change it beforehand */
+static int32_t encStartValue[ENC_HDLR_DEV_NUM] = {AMP_HDLR_VOL_POS_DEFAULT, ENC_CVAL_DEFAULT, ENC_CVAL_DEFAULT};
+
+/* CVAL, CMAX, CMIN and ISTEP are contiguous and go out as a single burst */
+static const tI2cHdlrRegCfg encRegConf[ENC_CFG_LENGTH] = { {0x04u, 1u, {0x18u}},
+														   {0x08u, 4u, {0x00u, 0x00u, 0x00u, 0x06u}},
+														   {0x0Cu, 4u, {0x00u, 0x00u, 0x00u, 0x10u}},
+														   {0x10u, 4u, {0x00u, 0x00u, 0x00u, 0x00u}},
+														   {0x14u, 4u, {0x00u, 0x00u, 0x00u, 0x01u}},
+														   {0x30u, 4u, {0x00u, 0x00u, 0x00u, 0x01u}},
+														 };
+/* Volume knob, counts over the positions of the amplifier volume curves */
+static const tI2cHdlrRegCfg encRegConfVol[ENC_CFG_LENGTH] = { {0x04u, 1u, {0x18u}},
+															  {0x08u, 4u, ENC_REG32(AMP_HDLR_VOL_POS_DEFAULT)},
+															  {0x0Cu, 4u, ENC_REG32(AMP_HDLR_VOL_POS_MAX)},
+															  {0x10u, 4u, {0x00u, 0x00u, 0x00u, 0x00u}},
+															  {0x14u, 4u, {0x00u, 0x00u, 0x00u, 0x01u}},
+															  {0x30u, 4u, {0x00u, 0x00u, 0x00u, 0x01u}},
+															};
+
+static const tDevHdlrWrite encStepWr[ENC_HDLR_DEV_NUM][1] =
+{
+	{ {ENC_ISTEP_REG, 4u, encInst[ENC_HDLR_DEV_VOLUME].stepReg, NULL} },
+	{ {ENC_ISTEP_REG, 4u, encInst[ENC_HDLR_DEV_BALANCE].stepReg, NULL} },
+	{ {ENC_ISTEP_REG, 4u, encInst[ENC_HDLR_DEV_AGC].stepReg, NULL} },
+};
+
+/* All encoders pull the same open-drain INT (PA10), addresses set by the A0..A6 jumpers */
+static const tEncHdlrDevCfg encDevCfg[ENC_HDLR_DEV_NUM] =
+{
+	{ TRUE, encRegConfVol, { "Volume encoder", I2C_HDLR_MOD1, 0x8Eu, encInst[ENC_HDLR_DEV_VOLUME].regConf, ENC_CFG_LENGTH, NULL, 0u,
+			  encStepWr[ENC_HDLR_DEV_VOLUME], 1u, &encInst[ENC_HDLR_DEV_VOLUME].shadow } },
+	{ FALSE, encRegConf, { "Balance encoder", I2C_HDLR_MOD1, 0x90u, encInst[ENC_HDLR_DEV_BALANCE].regConf, ENC_CFG_LENGTH, NULL, 0u,
+			   encStepWr[ENC_HDLR_DEV_BALANCE], 1u, &encInst[ENC_HDLR_DEV_BALANCE].shadow } },
+	{ FALSE, encRegConf, { "AGC encoder", I2C_HDLR_MOD1, 0x92u, encInst[ENC_HDLR_DEV_AGC].regConf, ENC_CFG_LENGTH, NULL, 0u,
+			   encStepWr[ENC_HDLR_DEV_AGC], 1u, &encInst[ENC_HDLR_DEV_AGC].shadow } },
+};
+
+/* Status (0x05..0x07) and counter (0x08..0x0B) move with the knob */
+static const uint8_t encShadowVolatile[I2C_HDLR_SHADOW_MAP_LEN(ENC_REG_NUM)] = {0xE0u, 0x0Fu};
+
+static uint8_t encStsRegAddr = ENC_ESTATUS_REG;
+static uint8_t encCvalRegAddr = ENC_CVAL_REG;
 static char debugLocalStr[256];
-static uint8_t encVal = 6u;
 
-EncHdlrErrCode EncHdlrInit (void)
+/* Service round: encoders in order from encSvcFirst, the last one that moved */
+static uint32_t encSvcFirst;
+static uint32_t encSvcCnt;
+
+/*
+ * Single producer (EncHdlrRun), any number of consumers each with its own
+ * cursor. A slot is filled before encEventHead publishes it, a reader checks
+ * after copying that the slot was not recycled meanwhile.
+ */
+static tEncHdlrEvent encEventRing[ENC_EVENT_RING_LEN];
+static volatile uint32_t encEventHead;
+
+static const tEncHdlrAccel encAccelDefault[] = { {0u, 1u}, {8u, 2u}, {16u, 4u} };
+
+/* INT line (PA10, active low until every ESTATUS is read) latched by EXTI */
+static EXTI_HandleTypeDef encExti;
+static volatile uint32_t encIntCnt;
+static volatile uint32_t encIntStamp;
+static uint32_t encIntSeen;
+static uint32_t encEventStamp;
+
+static void EncHdlrIntCallback (void)
 {
-	fsmsts = ENC_HDLR_INIT;
+	encIntStamp = DWT->CYCCNT;
+	encIntCnt++;
 }
 
-EncHdlrErrCode EncHdlrRun (void)
+static void EncHdlrIntLatchPin (void)
 {
-	EncHdlrErrCode result = ENC_HDLR_OK;
-	static int tmr;
-    static int idx = 0u;
-    static int cfgIdx = 0u;
+	/* Only the falling edge interrupts, catch a line already low when armed */
+	if (HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_10) == GPIO_PIN_RESET)
+	{
+		encIntStamp = DWT->CYCCNT;
+		encIntCnt++;
+	}
+}
 
-    float tempVal = 0;
-    float tempValDec;
+static uint32_t EncHdlrWindowCycles (void)
+{
+	return (SystemCoreClock / 1000u) * ENC_VEL_WINDOW_MS;
+}
 
+static void EncHdlrSetStep (uint32_t dev, uint32_t step)
+{
+	tEncHdlrInstance *inst = &encInst[dev];
 
-	switch (fsmsts)
+	/* Counter limits stay in CMIN/CMAX, the device clamps the larger steps */
+	inst->step = step;
+	inst->stepReg[0] = (uint8_t)(step >> 24);
+	inst->stepReg[1] = (uint8_t)(step >> 16);
+	inst->stepReg[2] = (uint8_t)(step >> 8);
+	inst->stepReg[3] = (uint8_t)step;
+}
+
+static void EncHdlrAccelUpdate (uint32_t dev, int32_t delta)
+{
+	tEncHdlrInstance *inst = &encInst[dev];
+	uint32_t detents;
+	uint32_t rate = 0u;
+	uint32_t step = 1u;
+	uint32_t idx;
+
+	/* Counter moved by ISTEP per detent */
+	detents = ((delta < 0) ? -delta : delta) / inst->step;
+	if (detents == 0u)
 	{
-		case ENC_HDLR_INIT:
-			/* Start with the initialization */
-			/* Copy here */
-			fsmsts = ENC_HDLR_CFG;
-			break;
+		detents = 1u;
+	}
+	inst->velStamp[inst->velIdx] = encEventStamp;
+	inst->velDetents[inst->velIdx] = detents;
+	inst->velIdx = (inst->velIdx + 1u) % ENC_VEL_HIST_LEN;
+
+	for (idx = 0u; idx < ENC_VEL_HIST_LEN; idx++)
+	{
+		if ( (inst->velDetents[idx] != 0u) && ((encEventStamp - inst->velStamp[idx]) < EncHdlrWindowCycles()) )
+		{
+			rate += inst->velDetents[idx];
+		}
+	}
+	rate = (rate * 1000u) / ENC_VEL_WINDOW_MS;
+
+	for (idx = 0u; idx < inst->accelLength; idx++)
+	{
+		if (rate >= inst->accelCurve[idx].minRate)
+		{
+			step = inst->accelCurve[idx].step;
+		}
+	}
 
-		case ENC_HDLR_CFG:
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD1, devAddress, encRegConf[cfgIdx].cnf, encRegConf[cfgIdx].length) == ENC_HDLR_OK)
+	EncHdlrSetStep(dev, step);
+}
+
+static void EncHdlrPublish (const tEncHdlrEvent *event)
+{
+	encEventRing[encEventHead & (ENC_EVENT_RING_LEN - 1u)] = *event;
+	__DMB();
+	encEventHead++;
+}
+
+/*
+ * Queues the status read of every enabled encoder, resuming where the last
+ * call stopped when the bus queue was full. The likely source gets ESTATUS
+ * and CVAL in one burst so a single knob in use costs one transaction, the
+ * others only ESTATUS which also releases their hold on INT.
+ */
+static boolean EncHdlrStatusQueue (void)
+{
+	boolean result = TRUE;
+	tEncHdlrInstance *inst;
+	uint32_t dev;
+	uint16_t length;
+
+	while ( (encSvcCnt < ENC_HDLR_DEV_NUM) && (result == TRUE) )
+	{
+		dev = (encSvcFirst + encSvcCnt) % ENC_HDLR_DEV_NUM;
+		inst = &encInst[dev];
+		if (encDevCfg[dev].isEnabled != TRUE)
+		{
+			encSvcCnt++;
+		}
+		else
+		{
+			inst->isFullRead = (dev == encSvcFirst) ? TRUE : FALSE;
+			length = (inst->isFullRead == TRUE) ? ENC_EVENT_LENGTH : 1u;
+			if (I2cHdlrRegRead(encDevCfg[dev].desc.i2cIdx, encDevCfg[dev].desc.addr, &encStsRegAddr,
+							   inst->dataReg, length, &inst->readStatus) == I2C_HDLR_OK)
 			{
-				fsmsts = ENC_HDLR_CFG_WAIT;
+				encSvcCnt++;
 			}
-			break;
-
-		case ENC_HDLR_CFG_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD1) == FALSE)
+			else
 			{
-				cfgIdx++;
-				if (cfgIdx < ENC_CFG_LENGTH)
-				{
-					fsmsts = ENC_HDLR_CFG;
-				}
-				else
-				{
-					fsmsts = ENC_HDLR_PREIDLE;
-				}
-	            TimerSet(&tmr, 600);
+				result = FALSE;
 			}
-			break;
+		}
+	}
 
-		case ENC_HDLR_PREIDLE:
-            PRINT_DEBUG("[Encoder]: Initialization completed\r\n");
-            fsmsts = ENC_HDLR_IDLE;
-            break;
+	return result;
+}
 
-		case ENC_HDLR_IDLE:
-			if (HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_10) == GPIO_PIN_RESET )
+/* Counter reads, only for the encoders whose status reports a move */
+static boolean EncHdlrPosQueue (void)
+{
+	boolean result = TRUE;
+	tEncHdlrInstance *inst;
+	uint32_t dev;
+
+	while ( (encSvcCnt < ENC_HDLR_DEV_NUM) && (result == TRUE) )
+	{
+		dev = (encSvcFirst + encSvcCnt) % ENC_HDLR_DEV_NUM;
+		inst = &encInst[dev];
+		if ( (encDevCfg[dev].isEnabled != TRUE) || (inst->isFullRead == TRUE) ||
+			 (inst->readStatus != I2C_HDLR_TR_OK) || ((inst->dataReg[0] & ENC_HDLR_ST_MOVED) == 0u) )
+		{
+			encSvcCnt++;
+		}
+		else if (I2cHdlrRegRead(encDevCfg[dev].desc.i2cIdx, encDevCfg[dev].desc.addr, &encCvalRegAddr,
+								&inst->dataReg[ENC_EVENT_CVAL_OFFS], ENC_CVAL_LENGTH, &inst->readStatus) == I2C_HDLR_OK)
+		{
+			encSvcCnt++;
+		}
+		else
+		{
+			result = FALSE;
+		}
+	}
+
+	return result;
+}
+
+static boolean EncHdlrIsReadPending (void)
+{
+	boolean result = FALSE;
+	uint32_t dev;
+
+	for (dev = 0u; dev < ENC_HDLR_DEV_NUM; dev++)
+	{
+		if ( (encDevCfg[dev].isEnabled == TRUE) && (encInst[dev].readStatus == I2C_HDLR_TR_PENDING) )
+		{
+			result = TRUE;
+		}
+	}
+
+	return result;
+}
+
+static void EncHdlrDecodeEvent (uint32_t dev)
+{
+	tEncHdlrInstance *inst = &encInst[dev];
+	tEncHdlrEvent *event = &inst->lastEvent;
+	uint32_t len;
+	const uint8_t *cval = &inst->dataReg[ENC_EVENT_CVAL_OFFS];
+
+	event->stamp = encEventStamp;
+	event->dev = (tEncHdlrDevIdx)dev;
+	event->status = inst->dataReg[0];
+	if ( (inst->isFullRead == TRUE) || ((event->status & ENC_HDLR_ST_MOVED) != 0u) )
+	{
+		event->value = (int32_t)(((uint32_t)cval[0] << 24) | ((uint32_t)cval[1] << 16) |
+								 ((uint32_t)cval[2] << 8) | cval[3]);
+	}
+	else
+	{
+		/* Button only, the counter was not read */
+		event->value = inst->prevValue;
+	}
+	event->delta = event->value - inst->prevValue;
+	if ((event->status & ENC_HDLR_ST_PUSHP) != 0u)
+	{
+		inst->isPressed = TRUE;
+	}
+	if ((event->status & ENC_HDLR_ST_PUSHR) != 0u)
+	{
+		inst->isPressed = FALSE;
+	}
+	event->isPressed = inst->isPressed;
+
+	if (event->delta != 0)
+	{
+		EncHdlrAccelUpdate(dev, event->delta);
+		inst->prevValue = event->value;
+		/* Most likely to move again, served first on the next INT */
+		encSvcFirst = dev;
+	}
+	EncHdlrPublish(event);
+
+	len = sprintf(debugLocalStr, "[Encoder %u]: Encoder value: %d step %u (%u us after INT)",
+				  (unsigned int)dev, (int)event->value, (unsigned int)inst->step,
+				  (unsigned int)((DWT->CYCCNT - encEventStamp) / (SystemCoreClock / 1000000u)));
+	if ((event->status & ENC_HDLR_ST_RINC) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " inc");
+	}
+	if ((event->status & ENC_HDLR_ST_RDEC) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " dec");
+	}
+	if ((event->status & ENC_HDLR_ST_RMAX) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " max");
+	}
+	if ((event->status & ENC_HDLR_ST_RMIN) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " min");
+	}
+	if ((event->status & ENC_HDLR_ST_PUSHP) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " push");
+	}
+	if ((event->status & ENC_HDLR_ST_PUSHR) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " release");
+	}
+	if ((event->status & ENC_HDLR_ST_PUSHD) != 0u)
+	{
+		len += sprintf(&debugLocalStr[len], " double-push");
+	}
+	sprintf(&debugLocalStr[len], "\r\n");
+	PRINT_DEBUG(debugLocalStr);
+}
+
+EncHdlrErrCode EncHdlrInit (void)
+{
+	EXTI_ConfigTypeDef extiCfg = {0};
+	tEncHdlrInstance *inst;
+	uint32_t dev;
+	uint32_t row;
+
+	encSvcFirst = ENC_HDLR_DEV_NUM;
+	for (dev = 0u; dev < ENC_HDLR_DEV_NUM; dev++)
+	{
+		inst = &encInst[dev];
+		inst->shadow.addr = encDevCfg[dev].desc.addr;
+		inst->shadow.regNum = ENC_REG_NUM;
+		inst->shadow.volatileMap = encShadowVolatile;
+		inst->shadow.value = inst->shadowValue;
+		inst->shadow.validMap = inst->shadowValid;
+		inst->readStatus = I2C_HDLR_TR_OK;
+		inst->isFullRead = FALSE;
+		inst->isPressed = FALSE;
+		inst->lastEvent.dev = (tEncHdlrDevIdx)dev;
+		inst->lastEvent.isPressed = FALSE;
+		inst->prevValue = encStartValue[dev];
+		for (row = 0u; row < ENC_CFG_LENGTH; row++)
+		{
+			inst->regConf[row] = encDevCfg[dev].regConf[row];
+			if (inst->regConf[row].reg == ENC_CVAL_REG)
 			{
-				fsmsts = ENC_HDLR_GETSTSTX;
+				inst->regConf[row].value[0] = (uint8_t)((uint32_t)encStartValue[dev] >> 24);
+				inst->regConf[row].value[1] = (uint8_t)((uint32_t)encStartValue[dev] >> 16);
+				inst->regConf[row].value[2] = (uint8_t)((uint32_t)encStartValue[dev] >> 8);
+				inst->regConf[row].value[3] = (uint8_t)encStartValue[dev];
 			}
-			break;
-
-		case ENC_HDLR_GETSTSTX:
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD1, devAddress, &encStsPosRegAddr, 1) == I2C_HDLR_OK)
+		}
+		EncHdlrSetStep(dev, 1u);
+		inst->accelCurve = encAccelDefault;
+		inst->accelLength = sizeof(encAccelDefault) / sizeof(encAccelDefault[0]);
+		if (encDevCfg[dev].isEnabled == TRUE)
+		{
+			DevHdlrAttach(&encDevCfg[dev].desc, &inst->engDev);
+			if (encSvcFirst == ENC_HDLR_DEV_NUM)
 			{
-				fsmsts = ENC_HDLR_GETSTSTX_WAIT;
+				encSvcFirst = dev;
 			}
-			break;
+		}
+	}
+	if (encSvcFirst == ENC_HDLR_DEV_NUM)
+	{
+		encSvcFirst = 0u;
+	}
+
+	/* PA10 stays a pulled-up input (HAL_MspInit), EXTI watches it */
+	extiCfg.Line = EXTI_LINE_10;
+	extiCfg.Mode = EXTI_MODE_INTERRUPT;
+	extiCfg.Trigger = EXTI_TRIGGER_FALLING;
+	extiCfg.GPIOSel = EXTI_GPIOA;
+	HAL_EXTI_SetConfigLine(&encExti, &extiCfg);
+	HAL_EXTI_RegisterCallback(&encExti, HAL_EXTI_COMMON_CB_ID, EncHdlrIntCallback);
+	encIntCnt = 0u;
+	encIntSeen = 0u;
+	HAL_NVIC_SetPriority(EXTI15_10_IRQn, ENC_INT_IRQ_PRIO, 0u);
+	HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+
+	fsmsts = ENC_HDLR_INIT;
+}
+
+EncHdlrErrCode EncHdlrRun (void)
+{
+	EncHdlrErrCode result = ENC_HDLR_OK;
+	boolean isReady = TRUE;
+	uint32_t dev;
 
-		case ENC_HDLR_GETSTSTX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD1) == FALSE)
+	switch (fsmsts)
+	{
+		case ENC_HDLR_INIT:
+			/* The engine loads the configuration table of every encoder */
+			for (dev = 0u; dev < ENC_HDLR_DEV_NUM; dev++)
 			{
-				fsmsts = ENC_HDLR_GETSTSRX;
+				if ( (encDevCfg[dev].isEnabled == TRUE) && (DevHdlrIsReady(encInst[dev].engDev) != TRUE) )
+				{
+					isReady = FALSE;
+				}
 			}
-			break;
-
-		case ENC_HDLR_GETSTSRX:
-			if (I2cHdlrMasterRx(I2C_HDLR_MOD1, devAddress, dataReg, 1) == I2C_HDLR_OK)
+			if (isReady == TRUE)
 			{
-				fsmsts = ENC_HDLR_GETSTSRX_WAIT;
+				fsmsts = ENC_HDLR_PREIDLE;
 			}
 			break;
 
-		case ENC_HDLR_GETSTSRX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD1) == FALSE)
+		case ENC_HDLR_PREIDLE:
+            EncHdlrIntLatchPin();
+            fsmsts = ENC_HDLR_IDLE;
+            break;
+
+		case ENC_HDLR_IDLE:
+			/* Events seen while busy collapse into one round, ESTATUS accumulates them */
+			if (encIntCnt != encIntSeen)
 			{
-				fsmsts = ENC_HDLR_GETPOSTX;
+				encIntSeen = encIntCnt;
+				encEventStamp = encIntStamp;
+				encSvcCnt = 0u;
+				fsmsts = ENC_HDLR_GETSTATUS;
+			}
+			else
+			{
+				for (dev = 0u; dev < ENC_HDLR_DEV_NUM; dev++)
+				{
+					if ( (encDevCfg[dev].isEnabled == TRUE) && (encInst[dev].step != 1u) &&
+						 ((DWT->CYCCNT - encInst[dev].lastEvent.stamp) >= EncHdlrWindowCycles()) )
+					{
+						/* Knob at rest, the next detent is a fine one again */
+						EncHdlrSetStep(dev, 1u);
+					}
+				}
 			}
 			break;
 
-		case ENC_HDLR_GETPOSTX:
-			if (I2cHdlrMasterTx(I2C_HDLR_MOD1, devAddress, &encValPosRegAddr, 1) == I2C_HDLR_OK)
+		case ENC_HDLR_GETSTATUS:
+			/* Any encoder may hold the shared INT low, all of them are asked */
+			if (EncHdlrStatusQueue() == TRUE)
 			{
-				fsmsts = ENC_HDLR_GETPOSTX_WAIT;
+				fsmsts = ENC_HDLR_GETSTATUS_WAIT;
 			}
 			break;
 
-		case ENC_HDLR_GETPOSTX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD1) == FALSE)
+		case ENC_HDLR_GETSTATUS_WAIT:
+			if (EncHdlrIsReadPending() != TRUE)
 			{
-				fsmsts = ENC_HDLR_GETPOSRX;
+				encSvcCnt = 0u;
+				fsmsts = ENC_HDLR_GETPOS;
 			}
 			break;
 
-		case ENC_HDLR_GETPOSRX:
-			if (I2cHdlrMasterRx(I2C_HDLR_MOD1, devAddress, dataReg, 4) == I2C_HDLR_OK)
+		case ENC_HDLR_GETPOS:
+			if (EncHdlrPosQueue() == TRUE)
 			{
-				fsmsts = ENC_HDLR_GETPOSRX_WAIT;
+				fsmsts = ENC_HDLR_GETPOS_WAIT;
 			}
 			break;
 
-		case ENC_HDLR_GETPOSRX_WAIT:
-			if (I2cHdlrIsFsmBusy(I2C_HDLR_MOD1) == FALSE)
+		case ENC_HDLR_GETPOS_WAIT:
+			if (EncHdlrIsReadPending() != TRUE)
 			{
-                sprintf(debugLocalStr, "[Encoder]: Encoder value: %d\r\n", dataReg[3]);
-				PRINT_DEBUG(debugLocalStr);
-				if (encVal != dataReg[3])
+				for (dev = 0u; dev < ENC_HDLR_DEV_NUM; dev++)
 				{
-					encVal = dataReg[3];
-					AmpHdlrSetGain(encVal);
+					/* Encoders with nothing to report read back a null status */
+					if ( (encDevCfg[dev].isEnabled == TRUE) && (encInst[dev].readStatus == I2C_HDLR_TR_OK) &&
+						 (encInst[dev].dataReg[0] != 0u) )
+					{
+						EncHdlrDecodeEvent(dev);
+					}
 				}
+				/* Status reads released the line, a new event may already hold it low */
+				EncHdlrIntLatchPin();
 				fsmsts = ENC_HDLR_IDLE;
-	            TimerSet(&tmr, 600);
 			}
 			break;
 
@@ -190,3 +554,87 @@ EncHdlrErrCode EncHdlrRun (void)
 	return result;
 }
 
+void EncHdlrIntIrqHandler (void)
+{
+	HAL_EXTI_IRQHandler(&encExti);
+}
+
+void EncHdlrGetLastEvent (tEncHdlrDevIdx dev, tEncHdlrEvent *event)
+{
+	if (dev < ENC_HDLR_DEV_NUM)
+	{
+		*event = encInst[dev].lastEvent;
+	}
+}
+
+/* Points in increasing minRate order, the first one should start at 0 */
+EncHdlrErrCode EncHdlrSetAccelCurve (tEncHdlrDevIdx dev, const tEncHdlrAccel *curve, uint32_t length)
+{
+	EncHdlrErrCode result = ENC_HDLR_ERR;
+
+	if ( (dev < ENC_HDLR_DEV_NUM) && (curve != NULL) && (length != 0u) )
+	{
+		encInst[dev].accelCurve = curve;
+		encInst[dev].accelLength = length;
+		result = ENC_HDLR_OK;
+	}
+
+	return result;
+}
+
+/* Starts at the current head, past events are not replayed */
+void EncHdlrReaderInit (tEncHdlrReader *reader)
+{
+	reader->tail = encEventHead;
+	reader->lost = 0u;
+}
+
+EncHdlrErrCode EncHdlrRead (tEncHdlrReader *reader, tEncHdlrEvent *event)
+{
+	EncHdlrErrCode result = ENC_HDLR_NODATA;
+	uint32_t head = encEventHead;
+
+	/*
+	 * The oldest slot is the next one EncHdlrPublish writes, before head
+	 * moves: it is taken as overwritten and ENC_EVENT_RING_LEN - 1 events
+	 * stay readable.
+	 */
+	if ((head - reader->tail) >= ENC_EVENT_RING_LEN)
+	{
+		/* Too slow, skip to the oldest event that cannot be torn */
+		reader->lost += (head - reader->tail) - (ENC_EVENT_RING_LEN - 1u);
+		reader->tail = head - (ENC_EVENT_RING_LEN - 1u);
+	}
+
+	if (reader->tail != head)
+	{
+		*event = encEventRing[reader->tail & (ENC_EVENT_RING_LEN - 1u)];
+		__DMB();
+		if ((encEventHead - reader->tail) < ENC_EVENT_RING_LEN)
+		{
+			reader->tail++;
+			result = ENC_HDLR_OK;
+		}
+		else
+		{
+			/* Slot recycled while copying, retry from the oldest on the next call */
+			result = ENC_HDLR_BUSY;
+		}
+	}
+
+	return result;
+}
+
+/* Counter the encoder starts from, only taken by EncHdlrInit */
+EncHdlrErrCode EncHdlrSetStartValue (tEncHdlrDevIdx dev, int32_t value)
+{
+	EncHdlrErrCode result = ENC_HDLR_ERR;
+
+	if (dev < ENC_HDLR_DEV_NUM)
+	{
+		encStartValue[dev] = value;
+		result = ENC_HDLR_OK;
+	}
+
+	return result;
+}
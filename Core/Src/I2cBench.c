@@ -0,0 +1,249 @@
+/**
+  ******************************************************************************
+  * @file           : I2cBench.c
+  * @brief          : I2c backend benchmark
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Runs the same register read (pointer write, repeated start, 4 bytes read)
+ * a fixed number of times with every backend and reports, per transaction,
+ * the cycles from the request being accepted to its status word turning
+ * final as seen by the superloop, and the number of superloop passes it took.
+ * Each read is queued on an idle bus with no retry, so the traffic of the
+ * other devices is not timed, and a failed read is counted but not averaged.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+#define I2C_BENCH_ITERATIONS 64u
+#define I2C_BENCH_RX_LENGTH 4u
+#define I2C_BENCH_BACKEND_NUM 3u
+
+typedef enum
+{
+	I2C_BENCH_IDLE = 0,
+	I2C_BENCH_SETBACKEND,
+	I2C_BENCH_READ,
+	I2C_BENCH_READ_WAIT,
+	I2C_BENCH_RESTORE,
+	I2C_BENCH_REPORT
+} tI2cBenchFsmSts;
+
+typedef struct
+{
+	uint32_t cyclesSum;
+	uint32_t cyclesMax;
+	uint32_t loopsSum;
+	uint32_t count;
+	uint32_t failCnt;
+} tI2cBenchStat;
+
+static const tI2cHdlrBackend benchBackend[I2C_BENCH_BACKEND_NUM] = {I2C_HDLR_BACKEND_POLL, I2C_HDLR_BACKEND_IRQ, I2C_HDLR_BACKEND_DMA};
+static const char *benchBackendName[I2C_BENCH_BACKEND_NUM] = {"poll", "irq", "dma"};
+
+static tI2cBenchFsmSts fsmsts = I2C_BENCH_IDLE;
+static tI2cHdlrModIdx benchDevIdx;
+static tI2cHdlrBackend benchPrevBackend;
+static uint32_t benchBackendNum;
+static uint8_t benchAddr;
+static uint8_t benchRegAddr;
+static uint8_t benchData[I2C_BENCH_RX_LENGTH];
+static volatile tI2cHdlrTrStatus benchStatus;
+static tI2cBenchStat benchStat[I2C_BENCH_BACKEND_NUM];
+static char benchStr[512];
+
+static void I2cBenchAccount (tI2cBenchStat *stat, uint32_t start, uint32_t loops)
+{
+	uint32_t cycles = DWT->CYCCNT - start;
+
+	if (benchStatus != I2C_HDLR_TR_OK)
+	{
+		stat->failCnt++;
+	}
+	else
+	{
+		stat->cyclesSum += cycles;
+		stat->loopsSum += loops;
+		stat->count++;
+		if (cycles > stat->cyclesMax)
+		{
+			stat->cyclesMax = cycles;
+		}
+	}
+}
+
+/* Register pointer write then the read after a repeated start, no retry */
+static I2cHdlrErrCode I2cBenchRead (void)
+{
+	tI2cHdlrTr tr = {0};
+
+	tr.addr = benchAddr;
+	tr.pTxData = &benchRegAddr;
+	tr.txLength = 1u;
+	tr.pRxData = benchData;
+	tr.rxLength = I2C_BENCH_RX_LENGTH;
+	tr.pStatus = &benchStatus;
+
+	return I2cHdlrEnqueue(benchDevIdx, &tr);
+}
+
+I2cBenchErrCode I2cBenchInit (void)
+{
+	/* Cycle counter, the time base of the benchmark, is started by I2cHdlrInit */
+	fsmsts = I2C_BENCH_IDLE;
+
+	return I2C_BENCH_OK;
+}
+
+I2cBenchErrCode I2cBenchStart (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t regAddr)
+{
+	I2cBenchErrCode result = I2C_BENCH_BUSY;
+
+	if (fsmsts == I2C_BENCH_IDLE)
+	{
+		benchDevIdx = devIdx;
+		benchAddr = addr;
+		benchRegAddr = regAddr;
+		benchPrevBackend = I2cHdlrGetBackend(devIdx);
+		memset(benchStat, 0, sizeof(benchStat));
+		benchBackendNum = I2C_BENCH_BACKEND_NUM;
+		fsmsts = I2C_BENCH_SETBACKEND;
+		result = I2C_BENCH_OK;
+	}
+
+	return result;
+}
+
+/* Polled backend only, the one a simulated bus supports */
+I2cBenchErrCode I2cBenchStartPolled (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t regAddr)
+{
+	I2cBenchErrCode result = I2cBenchStart(devIdx, addr, regAddr);
+
+	if (result == I2C_BENCH_OK)
+	{
+		benchBackendNum = 1u;
+	}
+
+	return result;
+}
+
+boolean I2cBenchIsRunning (void)
+{
+	boolean isRunning = TRUE;
+
+	if (fsmsts == I2C_BENCH_IDLE)
+	{
+		isRunning = FALSE;
+	}
+
+	return isRunning;
+}
+
+I2cBenchErrCode I2cBenchRun (void)
+{
+	I2cBenchErrCode result = I2C_BENCH_OK;
+	static uint32_t backendIdx;
+	static uint32_t iteration;
+	static uint32_t startCycles;
+	static uint32_t loops;
+	uint32_t idx;
+	uint32_t len;
+	tI2cBenchStat *stat;
+
+	switch (fsmsts)
+	{
+		case I2C_BENCH_IDLE:
+			break;
+
+		case I2C_BENCH_SETBACKEND:
+			if (I2cHdlrSetBackend(benchDevIdx, benchBackend[backendIdx]) == I2C_HDLR_OK)
+			{
+				iteration = 0u;
+				fsmsts = I2C_BENCH_READ;
+			}
+			break;
+
+		case I2C_BENCH_READ:
+			/* Started on an idle bus only, nothing queued ahead of it */
+			if ( (I2cHdlrIsFsmBusy(benchDevIdx) == FALSE) && (I2cBenchRead() == I2C_HDLR_OK) )
+			{
+				startCycles = DWT->CYCCNT;
+				loops = 0u;
+				fsmsts = I2C_BENCH_READ_WAIT;
+			}
+			break;
+
+		case I2C_BENCH_READ_WAIT:
+			loops++;
+			if (benchStatus != I2C_HDLR_TR_PENDING)
+			{
+				I2cBenchAccount(&benchStat[backendIdx], startCycles, loops);
+				iteration++;
+				if (iteration < I2C_BENCH_ITERATIONS)
+				{
+					fsmsts = I2C_BENCH_READ;
+				}
+				else
+				{
+					backendIdx++;
+					if (backendIdx < benchBackendNum)
+					{
+						fsmsts = I2C_BENCH_SETBACKEND;
+					}
+					else
+					{
+						backendIdx = 0u;
+						fsmsts = I2C_BENCH_RESTORE;
+					}
+				}
+			}
+			break;
+
+		case I2C_BENCH_RESTORE:
+			if (I2cHdlrSetBackend(benchDevIdx, benchPrevBackend) == I2C_HDLR_OK)
+			{
+				fsmsts = I2C_BENCH_REPORT;
+			}
+			break;
+
+		case I2C_BENCH_REPORT:
+			len = sprintf(benchStr, "\r\n[I2cBench]: %u iterations, %u cycles/ms\r\n",
+					      I2C_BENCH_ITERATIONS, (unsigned int)(SystemCoreClock / 1000u));
+			for (idx = 0u; idx < benchBackendNum; idx++)
+			{
+				stat = &benchStat[idx];
+				if (stat->count == 0u)
+				{
+					len += sprintf(&benchStr[len], "%s: no read completed, %u failed\r\n",
+								   benchBackendName[idx], (unsigned int)stat->failCnt);
+				}
+				else
+				{
+					len += sprintf(&benchStr[len], "%s: read avg %u max %u cyc %u loops, %u failed\r\n",
+								   benchBackendName[idx],
+								   (unsigned int)(stat->cyclesSum / stat->count),
+								   (unsigned int)stat->cyclesMax,
+								   (unsigned int)(stat->loopsSum / stat->count),
+								   (unsigned int)stat->failCnt);
+				}
+			}
+			UartDebugHdlrTx(benchStr, len);
+			fsmsts = I2C_BENCH_IDLE;
+			break;
+	}
+
+	return result;
+}
@@ -1,417 +1,1667 @@
-/**
-  ******************************************************************************
-  * @file           : I2cHdlr.c
-  * @brief          : I2c Handler
-  ******************************************************************************
-  * @attention
-  *
-  * Copyright (c) 2023 EmbeddedEspresso.
-  * All rights reserved.
-  *
-  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
-  * license. You may not use this file except in compliance with the License.
-  * You may obtain a copy of the License at:
-  * opensource.org/licenses/BSD-3-Clause
-  ******************************************************************************
-  */
-
-#include "main.h"
-
-#define I2cHdlrSetReset(m)			(m->CR1 |= 0x8000)
-#define I2cHdlrClrReset(m)			(m->CR1 &= ~0x8000)
-#define I2cHdlrSetClockFreq(m, f)	(m->CR2 = (f))
-#define I2cHdlrSetTRise(m, f)		(m->TRISE = (f))
-#define I2cHdlrSetClockConf(m, c)   (m->CCR = (c))
-#define I2cHdlrSetOAR1(m, c)		(m->OAR1 = (c))
-#define I2cHdlrEnableAck(m)			(m->CR1 |= 0x0400)
-#define I2cHdlrDisableAck(m)		(m->CR1 &= ~0x0400)
-#define I2cHdlrEnablePeri(m)		(m->CR1 |= 0x0001)
-#define I2cHdlrClrPec(m)			(m->CR1 &= ~0x0800)
-#define I2cHdlrSendStart(m) 		(m->CR1 |= 0x0100)
-#define I2cHdlrIsStartSent(m)		(((m->SR1) & 0x01) == 0x01)
-#define I2cHdlrSendData(m, d)		(m->DR = d)
-#define I2cHdlrReceiveData(m)		(m->DR)
-#define I2cHdlrIsAddrSent(m)		(((m->SR1) & 0x02) == 0x02)
-#define I2cHdlrIsNackRec(m)			(((m->SR1) & 0x0400) == 0x0400)
-#define I2cHdlrClrNack(m)			((m->SR1) &= ~0x0400)
-#define I2cHdlrSendStop(m)			(m->CR1 |= 0x0200)
-#define I2cHdlrIsTxRegEmpty(m)		((m->SR1 & 0x80) != 0)
-#define I2cHdlrIsRxRegNotEmpty(m)	((m->SR1 & 0x40) != 0)
-
-#define I2C_MAX_DEVICE_NUM 2
-
-typedef struct
-{
-    volatile uint32_t CR1;        /*!< I2C Control register 1,     Address offset: 0x00 */
-    volatile uint32_t CR2;        /*!< I2C Control register 2,     Address offset: 0x04 */
-    volatile uint32_t OAR1;       /*!< I2C Own address register 1, Address offset: 0x08 */
-    volatile uint32_t OAR2;       /*!< I2C Own address register 2, Address offset: 0x0C */
-    volatile uint32_t DR;         /*!< I2C Data register,          Address offset: 0x10 */
-    volatile uint32_t SR1;        /*!< I2C Status register 1,      Address offset: 0x14 */
-    volatile uint32_t SR2;        /*!< I2C Status register 2,      Address offset: 0x18 */
-    volatile uint32_t CCR;        /*!< I2C Clock control register, Address offset: 0x1C */
-    volatile uint32_t TRISE;      /*!< I2C TRISE register,         Address offset: 0x20 */
-    volatile uint32_t FLTR;       /*!< I2C FLTR register,          Address offset: 0x24 */
-} tI2cRegMap;
-
-typedef enum
-{
-    I2C_HDLR_INIT = 0,
-    I2C_HDLR_IDLE,
-    I2C_HDLR_DATATX,
-	I2C_HDLR_DATARX
-} tI2cHdlrFsmSts;
-
-typedef enum
-{
-    I2C_HDLR_TX_IDLE = 0,
-    I2C_HDLR_TX_STARTTX,
-	I2C_HDLR_TX_SENDADDR,
-	I2C_HDLR_TX_CHECKADDR,
-	I2C_HDLR_TX_SENDDATA,
-	I2C_HDLR_TX_SENDDATA_WAIT,
-} tI2cHdlrTxFsmSts;
-
-typedef enum
-{
-    I2C_HDLR_RX_IDLE = 0,
-    I2C_HDLR_RX_STARTRX,
-	I2C_HDLR_RX_SENDADDR,
-	I2C_HDLR_RX_CHECKADDR,
-	I2C_HDLR_RX_RECDATA,
-	I2C_HDLR_RX_RECDATA_WAIT,
-} tI2cHdlrRxFsmSts;
-
-typedef struct
-{
-    uint8_t *pData;
-    uint32_t length;
-    uint8_t addr;
-    uint8_t currPos;
-} tI2cHdlrCurrTr;
-
-typedef struct
-{
-	tI2cHdlrFsmSts fsmsts;
-	tI2cHdlrTxFsmSts fsmtxsts;
-	tI2cHdlrRxFsmSts fsmrxsts;
-	tI2cHdlrCurrTr currTr;
-	tI2cRegMap *regMap;
-} tI2cHdlrInstance;
-
-uint32_t i2cBaseAddr[] = {I2C1_BASE, I2C2_BASE, I2C3_BASE};
-
-/* 3 I2cs are present on the device */
-static tI2cHdlrInstance i2cHdlrInst[3];
-
-void I2cHdlrInit (void)
-{
-	uint32_t idx;
-
-    for (idx=0; idx<I2C_MAX_DEVICE_NUM; idx++)
-    {
-		i2cHdlrInst[idx].fsmsts = I2C_HDLR_INIT;
-		i2cHdlrInst[idx].fsmtxsts = I2C_HDLR_TX_IDLE;
-		i2cHdlrInst[idx].fsmrxsts = I2C_HDLR_RX_IDLE;
-		i2cHdlrInst[idx].regMap = i2cBaseAddr[idx];
-
-		I2cHdlrSetReset(i2cHdlrInst[idx].regMap);
-		I2cHdlrClrReset(i2cHdlrInst[idx].regMap);
-		I2cHdlrSetClockFreq(i2cHdlrInst[idx].regMap, 0x24u);
-		I2cHdlrSetTRise(i2cHdlrInst[idx].regMap, 0x25u);
-		I2cHdlrSetClockConf(i2cHdlrInst[idx].regMap, 0xb4u);
-		I2cHdlrSetOAR1(i2cHdlrInst[idx].regMap, 0x4000);
-
-		I2cHdlrEnablePeri(i2cHdlrInst[idx].regMap);
-    }
-
-    PRINT_DEBUG("[I2c]: Initialization completed\r\n");
-}
-
-void I2cHdlrRun (void)
-{
-    static int idx = 0u;
-    I2cHdlrErrCode trResult;
-
-    for (idx=0; idx<I2C_MAX_DEVICE_NUM; idx++)
-    {
-		switch (i2cHdlrInst[idx].fsmsts)
-		{
-			case I2C_HDLR_INIT:
-				/* Start with the initialization */
-				/* Copy here */
-				i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
-				break;
-
-			case I2C_HDLR_IDLE:
-
-				break;
-
-			case I2C_HDLR_DATATX:
-				trResult = I2cHdlrTxRun(idx);
-				if (trResult == I2C_HDLR_OK)
-				{
-					i2cHdlrInst[idx].fsmtxsts = I2C_HDLR_TX_IDLE;
-					i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
-				}
-				if (trResult == I2C_HDLR_ERR)
-				{
-					i2cHdlrInst[idx].fsmtxsts = I2C_HDLR_TX_IDLE;
-					i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
-				}
-
-				break;
-
-			case I2C_HDLR_DATARX:
-				trResult = I2cHdlrRxRun(idx);
-				if (trResult == I2C_HDLR_OK)
-				{
-					i2cHdlrInst[idx].fsmrxsts = I2C_HDLR_RX_IDLE;
-					i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
-				}
-				if (trResult == I2C_HDLR_ERR)
-				{
-					i2cHdlrInst[idx].fsmrxsts = I2C_HDLR_RX_IDLE;
-					i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
-				}
-
-				break;
-
-		}
-    }
-
-}
-
-I2cHdlrErrCode I2cHdlrTxRun (tI2cHdlrModIdx devIdx)
-{
-	I2cHdlrErrCode result = I2C_HDLR_BUSY;
-	static uint32_t currPos;
-	uint16_t tempreg;
-
-	switch (i2cHdlrInst[devIdx].fsmtxsts)
-	{
-		case I2C_HDLR_TX_IDLE:
-			result = I2C_HDLR_OK;
-			break;
-
-		case I2C_HDLR_TX_STARTTX:
-		    I2cHdlrEnableAck(i2cHdlrInst[devIdx].regMap);
-            /* Generate Start condition */
-			I2cHdlrSendStart(i2cHdlrInst[devIdx].regMap);
-            /* Wait start condition generation detection */
-			i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDADDR;
-            /* Send address */
-            break;
-
-		case I2C_HDLR_TX_SENDADDR:
-			/* Check if start condition has been sent */
-			if (I2cHdlrIsStartSent(i2cHdlrInst[devIdx].regMap))
-			{
-				I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, i2cHdlrInst[devIdx].currTr.addr);
-				/* Wait address sent condition generation detection */
-				i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_CHECKADDR;
-			}
-			break;
-
-		case I2C_HDLR_TX_CHECKADDR:
-			/* Check if address has been sent */
-			if (I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
-			{
-				/* This sequence, cleares the ADDR bit */
-				/* To be macrofied */
-				tempreg = i2cHdlrInst[devIdx].regMap->SR1;
-				tempreg = i2cHdlrInst[devIdx].regMap->SR2;
-
-				/* Check of NAK */
-				if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap))
-				{
-					/* Generate Stop */
-					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
-					/* Cleat ack failure */
-					I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
-
-					result = I2C_HDLR_ERR;
-				}
-				i2cHdlrInst[devIdx].currTr.currPos = 0u;
-				/* Wait address sent condition generation detection */
-				i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA;
-
-            }
-			break;
-
-		case I2C_HDLR_TX_SENDDATA:
-            /* Send data */
-			I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, i2cHdlrInst[devIdx].currTr.pData[i2cHdlrInst[devIdx].currTr.currPos]);
-			i2cHdlrInst[devIdx].currTr.currPos++;
-			i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA_WAIT;
-			break;
-
-		case I2C_HDLR_TX_SENDDATA_WAIT:
-
-			if(!I2cHdlrIsTxRegEmpty(i2cHdlrInst[devIdx].regMap))
-			{
-				/* Wait TXE to be set*/
-				if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap))
-				{
-					/* Generate Stop */
-					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
-					/* Cleat ack failure */
-					I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
-
-					result = I2C_HDLR_ERR;
-
-				}
-			}
-			else
-			{
-				if (i2cHdlrInst[devIdx].currTr.currPos == i2cHdlrInst[devIdx].currTr.length)
-				{
-					result = I2C_HDLR_OK;
-					/* Data transfer is finished */
-					i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_IDLE;
-					/* Generate Stop */
-					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
-				}
-				else
-				{
-					i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA;
-				}
-			}
-			break;
-	}
-
-	return result;
-}
-
-I2cHdlrErrCode I2cHdlrRxRun (tI2cHdlrModIdx devIdx)
-{
-	I2cHdlrErrCode result = I2C_HDLR_BUSY;
-	static uint32_t currPos;
-	uint16_t tempreg;
-
-	switch (i2cHdlrInst[devIdx].fsmrxsts)
-	{
-		case I2C_HDLR_RX_IDLE:
-			result = I2C_HDLR_OK;
-			break;
-
-		case I2C_HDLR_RX_STARTRX:
-		    I2cHdlrEnableAck(i2cHdlrInst[devIdx].regMap);
-            /* Generate Start condition */
-			I2cHdlrSendStart(i2cHdlrInst[devIdx].regMap);
-            /* Wait start condition generation detection */
-			i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_SENDADDR;
-            /* Send address */
-            break;
-
-		case I2C_HDLR_RX_SENDADDR:
-			/* Check if start condition has been sent */
-			if (I2cHdlrIsStartSent(i2cHdlrInst[devIdx].regMap))
-			{
-				I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, (i2cHdlrInst[devIdx].currTr.addr | 0x01));
-				/* Wait address sent condition generation detection */
-				i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_CHECKADDR;
-			}
-			break;
-
-		case I2C_HDLR_RX_CHECKADDR:
-			/* Check if address has been sent */
-			if (I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
-			{
-				if (i2cHdlrInst[devIdx].currTr.length == 1u)
-				{
-					/* A Nack must be set for the last byte to stop comm */
-					I2cHdlrDisableAck(i2cHdlrInst[devIdx].regMap);
-				}
-
-				/* This sequence, cleares the ADDR bit */
-				/* To be macrofied */
-				tempreg = i2cHdlrInst[devIdx].regMap->SR1;
-				tempreg = i2cHdlrInst[devIdx].regMap->SR2;
-
-				if (i2cHdlrInst[devIdx].currTr.length == 1u)
-				{
-					/* Generate Stop */
-					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
-				}
-
-				i2cHdlrInst[devIdx].currTr.currPos = 0u;
-				/* Wait address sent condition generation detection */
-				i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_RECDATA;
-
-            }
-			break;
-
-		case I2C_HDLR_RX_RECDATA:
-            if(I2cHdlrIsRxRegNotEmpty(i2cHdlrInst[devIdx].regMap))
-            {
-            	i2cHdlrInst[devIdx].currTr.pData[i2cHdlrInst[devIdx].currTr.currPos] = I2cHdlrReceiveData(i2cHdlrInst[devIdx].regMap);
-            	i2cHdlrInst[devIdx].currTr.currPos++;
-
-				if (i2cHdlrInst[devIdx].currTr.currPos == i2cHdlrInst[devIdx].currTr.length)
-				{
-					result = I2C_HDLR_OK;
-					/* Data transfer is finished */
-					i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_TX_IDLE;
-				}
-				else if(i2cHdlrInst[devIdx].currTr.currPos == (i2cHdlrInst[devIdx].currTr.length - 1u))
-				{
-					/* A Nack must be set for the last byte to stop comm */
-					I2cHdlrDisableAck(i2cHdlrInst[devIdx].regMap);
-					/* Generate Stop */
-					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
-				}
-            }
-			break;
-
-	}
-
-	return result;
-}
-
-boolean I2cHdlrIsFsmBusy (tI2cHdlrModIdx devIdx)
-{
-	boolean isBusy = TRUE;
-
-	if (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_IDLE)
-	{
-		isBusy = FALSE;
-	}
-
-	return isBusy;
-}
-
-I2cHdlrErrCode I2cHdlrMasterTx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length)
-{
-	I2cHdlrErrCode result = I2C_HDLR_BUSY;
-
-	if ( (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_IDLE) &&
-		 (i2cHdlrInst[devIdx].fsmtxsts == I2C_HDLR_TX_IDLE) )
-	{
-		i2cHdlrInst[devIdx].currTr.addr = addr;
-		i2cHdlrInst[devIdx].currTr.length = length;
-		i2cHdlrInst[devIdx].currTr.pData = data;
-		i2cHdlrInst[devIdx].fsmsts = I2C_HDLR_DATATX;
-		i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_STARTTX;
-		result = I2C_HDLR_OK;
-	}
-
-	return result;
-}
-
-I2cHdlrErrCode I2cHdlrMasterRx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length)
-{
-	I2cHdlrErrCode result = I2C_HDLR_BUSY;
-
-	if ( (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_IDLE) &&
-		 (i2cHdlrInst[devIdx].fsmrxsts == I2C_HDLR_RX_IDLE) )
-	{
-		i2cHdlrInst[devIdx].currTr.addr = addr;
-		i2cHdlrInst[devIdx].currTr.length = length;
-		i2cHdlrInst[devIdx].currTr.pData = data;
-		i2cHdlrInst[devIdx].fsmsts = I2C_HDLR_DATARX;
-		i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_STARTRX;
-		result = I2C_HDLR_OK;
-	}
-	return result;
-}
+/**
+  ******************************************************************************
+  * @file           : I2cHdlr.c
+  * @brief          : I2c Handler
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+
+#define I2cHdlrSetReset(m)			(m->CR1 |= 0x8000)
+#define I2cHdlrClrReset(m)			(m->CR1 &= ~0x8000)
+#define I2cHdlrSetClockFreq(m, f)	(m->CR2 = (f))
+#define I2cHdlrSetTRise(m, f)		(m->TRISE = (f))
+#define I2cHdlrSetClockConf(m, c)   (m->CCR = (c))
+#define I2cHdlrSetOAR1(m, c)		(m->OAR1 = (c))
+#define I2cHdlrEnableAck(m)			(m->CR1 |= 0x0400)
+#define I2cHdlrDisableAck(m)		(m->CR1 &= ~0x0400)
+#define I2cHdlrEnablePeri(m)		(m->CR1 |= 0x0001)
+#define I2cHdlrClrPec(m)			(m->CR1 &= ~0x0800)
+#define I2cHdlrSendStart(m) 		(m->CR1 |= 0x0100)
+#define I2cHdlrIsStartSent(m)		(((m->SR1) & 0x01) == 0x01)
+#define I2cHdlrSendData(m, d)		(m->DR = d)
+#define I2cHdlrReceiveData(m)		(m->DR)
+#define I2cHdlrIsAddrSent(m)		(((m->SR1) & 0x02) == 0x02)
+#define I2cHdlrIsNackRec(m)			(((m->SR1) & 0x0400) == 0x0400)
+#define I2cHdlrClrNack(m)			((m->SR1) &= ~0x0400)
+#define I2cHdlrSendStop(m)			(m->CR1 |= 0x0200)
+#define I2cHdlrIsTxRegEmpty(m)		((m->SR1 & 0x80) != 0)
+#define I2cHdlrIsRxRegNotEmpty(m)	((m->SR1 & 0x40) != 0)
+#define I2cHdlrIsStopPending(m)		((m->CR1 & 0x0200) != 0)
+#define I2cHdlrEnableIrq(m)			(m->CR2 |= 0x0700)
+#define I2cHdlrDisableIrq(m)		(m->CR2 &= ~0x0700)
+#define I2cHdlrDisableBufIrq(m)		(m->CR2 &= ~0x0400)
+#define I2cHdlrEnableDma(m)			(m->CR2 |= 0x0800)
+#define I2cHdlrSetDmaLast(m)		(m->CR2 |= 0x1000)
+#define I2cHdlrDisableDma(m)		(m->CR2 &= ~0x1800)
+
+#define I2C_HDLR_SR1_SB				0x0001u
+#define I2C_HDLR_SR1_ADDR			0x0002u
+#define I2C_HDLR_SR1_BTF			0x0004u
+#define I2C_HDLR_SR1_RXNE			0x0040u
+#define I2C_HDLR_SR1_TXE			0x0080u
+#define I2C_HDLR_SR1_BERR			0x0100u
+#define I2C_HDLR_SR1_ARLO			0x0200u
+#define I2C_HDLR_SR1_AF				0x0400u
+#define I2C_HDLR_SR1_OVR			0x0800u
+#define I2C_HDLR_SR1_ERRMASK		(I2C_HDLR_SR1_BERR | I2C_HDLR_SR1_ARLO | I2C_HDLR_SR1_AF | I2C_HDLR_SR1_OVR)
+
+#define I2C_HDLR_IRQ_PRIO			5u
+/* DMA completion must be served before the BTF event that follows it */
+#define I2C_HDLR_DMA_IRQ_PRIO		4u
+/* Transfers of at least this many bytes are moved by DMA on the DMA backend,
+ * must stay >= 2: a single byte reception needs the Nack before ADDR is cleared */
+#define I2C_HDLR_DMA_THRESHOLD		2u
+
+/* Descriptor ring size per bus, power of 2 */
+#define I2C_HDLR_QUEUE_LEN 8u
+/* Bounded wait for the previous stop before chaining the next start, in SCL
+ * periods, the start is left to I2cHdlrRun() after it */
+#define I2C_HDLR_STOP_WAIT_PERIODS 2u
+/* Longest time, in Timer.c ticks, a transaction may stay in one state */
+#define I2C_HDLR_STATE_TIMEOUT 10
+/* Shadowed devices per bus */
+#define I2C_HDLR_SHADOW_MAX 4u
+/* SCL pulses needed to make a slave release SDA, plus half period delay */
+#define I2C_HDLR_RECOVERY_CLOCKS 9u
+#define I2C_HDLR_RECOVERY_DELAY_LOOPS 40u
+
+/* CCR register fields */
+#define I2C_HDLR_CCR_FS				0x8000u
+#define I2C_HDLR_CCR_DUTY			0x4000u
+#define I2C_HDLR_CCR_MASK			0x0FFFu
+#define I2C_HDLR_CCR_MIN_SM			4u
+#define I2C_HDLR_CCR_MIN_FM			1u
+#define I2C_HDLR_FREQ_MIN_MHZ		2u
+#define I2C_HDLR_FREQ_MAX_MHZ		50u
+
+typedef struct
+{
+    volatile uint32_t CR1;        /*!< I2C Control register 1,     Address offset: 0x00 */
+    volatile uint32_t CR2;        /*!< I2C Control register 2,     Address offset: 0x04 */
+    volatile uint32_t OAR1;       /*!< I2C Own address register 1, Address offset: 0x08 */
+    volatile uint32_t OAR2;       /*!< I2C Own address register 2, Address offset: 0x0C */
+    volatile uint32_t DR;         /*!< I2C Data register,          Address offset: 0x10 */
+    volatile uint32_t SR1;        /*!< I2C Status register 1,      Address offset: 0x14 */
+    volatile uint32_t SR2;        /*!< I2C Status register 2,      Address offset: 0x18 */
+    volatile uint32_t CCR;        /*!< I2C Clock control register, Address offset: 0x1C */
+    volatile uint32_t TRISE;      /*!< I2C TRISE register,         Address offset: 0x20 */
+    volatile uint32_t FLTR;       /*!< I2C FLTR register,          Address offset: 0x24 */
+} tI2cRegMap;
+
+typedef enum
+{
+    I2C_HDLR_INIT = 0,
+    I2C_HDLR_IDLE,
+    I2C_HDLR_DATATX,
+	I2C_HDLR_DATARX,
+	/* Failed transaction waiting to be retried, still at the queue tail */
+	I2C_HDLR_BACKOFF
+} tI2cHdlrFsmSts;
+
+typedef enum
+{
+    I2C_HDLR_TX_IDLE = 0,
+    I2C_HDLR_TX_STARTTX,
+	I2C_HDLR_TX_SENDADDR,
+	I2C_HDLR_TX_CHECKADDR,
+	I2C_HDLR_TX_SENDDATA,
+	I2C_HDLR_TX_SENDDATA_WAIT,
+} tI2cHdlrTxFsmSts;
+
+typedef enum
+{
+    I2C_HDLR_RX_IDLE = 0,
+    I2C_HDLR_RX_STARTRX,
+	I2C_HDLR_RX_SENDADDR,
+	I2C_HDLR_RX_CHECKADDR,
+	I2C_HDLR_RX_RECDATA,
+	I2C_HDLR_RX_RECDATA_WAIT,
+} tI2cHdlrRxFsmSts;
+
+typedef struct
+{
+    uint8_t *pData;
+    uint32_t length;
+    uint8_t addr;
+    uint8_t currPos;
+    boolean isDma;
+    /* Read phase of a write-read, started with a repeated start */
+    uint8_t *pRxData;
+    uint32_t rxLength;
+} tI2cHdlrCurrTr;
+
+typedef struct
+{
+	DMA_Stream_TypeDef *stream;
+	uint32_t channel;
+	IRQn_Type irqNum;
+} tI2cHdlrDmaCfg;
+
+typedef struct
+{
+	uint32_t busFreq;
+	/* Low/high SCL period ratio, as low + high units of CCR */
+	uint32_t periodUnits;
+	uint32_t ccrFlags;
+	uint32_t ccrMin;
+	/* Max rise time in ns, sets TRISE */
+	uint32_t riseTimeNs;
+} tI2cHdlrSpeedCfg;
+
+typedef struct
+{
+	/* Shared with the event/error interrupts when the IRQ backend is used */
+	volatile tI2cHdlrFsmSts fsmsts;
+	volatile tI2cHdlrTxFsmSts fsmtxsts;
+	volatile tI2cHdlrRxFsmSts fsmrxsts;
+	tI2cHdlrCurrTr currTr;
+	tI2cRegMap *regMap;
+	tI2cHdlrBackend backend;
+	DMA_HandleTypeDef dmaTx;
+	DMA_HandleTypeDef dmaRx;
+	/* Pending transactions, queue[queueTail] is the one on the bus */
+	tI2cHdlrTr queue[I2C_HDLR_QUEUE_LEN];
+	volatile uint8_t queueHead;
+	volatile uint8_t queueTail;
+	/* Progress watchdog, re-armed whenever the transaction changes state */
+	uint32_t lastProgress;
+	int deadline;
+	uint32_t recoveryCnt;
+	tI2cHdlrSpeed speed;
+	/* CYCCNT cycles of I2C_HDLR_STOP_WAIT_PERIODS at the bus speed */
+	uint32_t stopWaitCycles;
+	/* Timing registers are reprogrammed once the bus is idle */
+	volatile boolean isClockDirty;
+	/* CYCCNT when each queue slot was filled and when the bus was taken */
+	uint32_t queueStamp[I2C_HDLR_QUEUE_LEN];
+	uint32_t busStart;
+	tI2cHdlrStats stats;
+	/* Outcome of the transaction on the bus, set where the failure is detected */
+	volatile tI2cHdlrTrStatus trStatus;
+	tI2cHdlrTrStatus lastStatus;
+	/* First failure of the chained descriptors completed so far */
+	tI2cHdlrTrStatus chainStatus;
+	uint8_t retryCnt;
+	int backoff;
+	tI2cHdlrShadow *shadow[I2C_HDLR_SHADOW_MAX];
+	uint8_t shadowNum;
+} tI2cHdlrInstance;
+
+static tI2cRegMap * const i2cBaseAddr[] = {(tI2cRegMap *)I2C1_BASE, (tI2cRegMap *)I2C2_BASE, (tI2cRegMap *)I2C3_BASE};
+static const IRQn_Type i2cEvIrqNum[] = {I2C1_EV_IRQn, I2C2_EV_IRQn, I2C3_EV_IRQn};
+static const IRQn_Type i2cErIrqNum[] = {I2C1_ER_IRQn, I2C2_ER_IRQn, I2C3_ER_IRQn};
+/* DMA1 request mapping, RM0390 table 28 */
+static const tI2cHdlrDmaCfg i2cDmaTxCfg[] = { {DMA1_Stream6, DMA_CHANNEL_1, DMA1_Stream6_IRQn},
+											  {DMA1_Stream7, DMA_CHANNEL_7, DMA1_Stream7_IRQn},
+											  {DMA1_Stream4, DMA_CHANNEL_3, DMA1_Stream4_IRQn} };
+static const tI2cHdlrDmaCfg i2cDmaRxCfg[] = { {DMA1_Stream0, DMA_CHANNEL_1, DMA1_Stream0_IRQn},
+											  {DMA1_Stream3, DMA_CHANNEL_7, DMA1_Stream3_IRQn},
+											  {DMA1_Stream2, DMA_CHANNEL_3, DMA1_Stream2_IRQn} };
+/* Indexed by tI2cHdlrSpeed, RM0390 I2C_CCR/I2C_TRISE */
+static const tI2cHdlrSpeedCfg i2cSpeedCfg[] = { {100000u, 2u, 0u, I2C_HDLR_CCR_MIN_SM, 1000u},
+												{400000u, 3u, I2C_HDLR_CCR_FS, I2C_HDLR_CCR_MIN_FM, 300u},
+												{400000u, 25u, (I2C_HDLR_CCR_FS | I2C_HDLR_CCR_DUTY), I2C_HDLR_CCR_MIN_FM, 300u},
+												{1000000u, 25u, (I2C_HDLR_CCR_FS | I2C_HDLR_CCR_DUTY), I2C_HDLR_CCR_MIN_FM, 120u} };
+static char debugLocalStr[64];
+static uint32_t statsLastRun;
+
+static void I2cHdlrPinInit (tI2cHdlrModIdx devIdx);
+static void I2cHdlrGpioClkEnable (GPIO_TypeDef *port);
+static void I2cHdlrHwInit (tI2cHdlrModIdx devIdx);
+static I2cHdlrErrCode I2cHdlrCalcTiming (tI2cHdlrSpeed speed, uint32_t *freq, uint32_t *ccr, uint32_t *trise);
+static uint32_t I2cHdlrProgress (tI2cHdlrModIdx devIdx);
+static void I2cHdlrCheckTimeout (tI2cHdlrModIdx devIdx);
+static void I2cHdlrIrqMask (tI2cHdlrModIdx devIdx);
+static void I2cHdlrIrqUnmask (tI2cHdlrModIdx devIdx);
+static void I2cHdlrRecover (tI2cHdlrModIdx devIdx);
+static void I2cHdlrRecoveryDelay (void);
+static void I2cHdlrIrqStop (tI2cHdlrModIdx devIdx);
+static void I2cHdlrLink (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr);
+static void I2cHdlrDispatch (tI2cHdlrModIdx devIdx);
+static void I2cHdlrTrDone (tI2cHdlrModIdx devIdx, I2cHdlrErrCode result);
+static void I2cHdlrStatsAccount (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr, tI2cHdlrTrStatus status);
+static void I2cHdlrSetFailure (tI2cHdlrModIdx devIdx, tI2cHdlrTrStatus status);
+static tI2cHdlrShadow *I2cHdlrShadowFind (tI2cHdlrModIdx devIdx, uint8_t addr);
+static void I2cHdlrShadowUpdate (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr);
+static void I2cHdlrIrqStart (tI2cHdlrModIdx devIdx);
+static void I2cHdlrIrqComplete (tI2cHdlrModIdx devIdx, I2cHdlrErrCode result);
+static void I2cHdlrRestartRx (tI2cHdlrModIdx devIdx);
+static void I2cHdlrDmaInit (tI2cHdlrModIdx devIdx, DMA_HandleTypeDef *hdma, const tI2cHdlrDmaCfg *cfg, uint32_t direction);
+static void I2cHdlrDmaTxCplt (DMA_HandleTypeDef *hdma);
+static void I2cHdlrDmaRxCplt (DMA_HandleTypeDef *hdma);
+
+static tI2cHdlrInstance i2cHdlrInst[I2C_HDLR_MOD_NUM];
+
+void I2cHdlrInit (void)
+{
+	uint32_t idx;
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /* Cycle counter timestamps the transactions */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0u;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    statsLastRun = 0u;
+
+    for (idx=0; idx<I2C_HDLR_MOD_NUM; idx++)
+    {
+		if (i2cHdlrBusCfg[idx].isEnabled != TRUE)
+		{
+			continue;
+		}
+
+		i2cHdlrInst[idx].fsmsts = I2C_HDLR_INIT;
+		i2cHdlrInst[idx].fsmtxsts = I2C_HDLR_TX_IDLE;
+		i2cHdlrInst[idx].fsmrxsts = I2C_HDLR_RX_IDLE;
+		i2cHdlrInst[idx].regMap = i2cBaseAddr[idx];
+		i2cHdlrInst[idx].backend = i2cHdlrBusCfg[idx].backend;
+		i2cHdlrInst[idx].queueHead = 0u;
+		i2cHdlrInst[idx].queueTail = 0u;
+		i2cHdlrInst[idx].recoveryCnt = 0u;
+		i2cHdlrInst[idx].lastStatus = I2C_HDLR_TR_OK;
+		i2cHdlrInst[idx].chainStatus = I2C_HDLR_TR_OK;
+		i2cHdlrInst[idx].retryCnt = 0u;
+		i2cHdlrInst[idx].shadowNum = 0u;
+		i2cHdlrInst[idx].speed = i2cHdlrBusCfg[idx].speed;
+		i2cHdlrInst[idx].isClockDirty = FALSE;
+		memset(&i2cHdlrInst[idx].stats, 0, sizeof(tI2cHdlrStats));
+
+		I2cHdlrPinInit(idx);
+		I2cHdlrHwInit(idx);
+
+		/* Interrupts are enabled per transaction by the IRQ backend */
+		HAL_NVIC_SetPriority(i2cEvIrqNum[idx], I2C_HDLR_IRQ_PRIO, 0u);
+		HAL_NVIC_SetPriority(i2cErIrqNum[idx], I2C_HDLR_IRQ_PRIO, 0u);
+		HAL_NVIC_EnableIRQ(i2cEvIrqNum[idx]);
+		HAL_NVIC_EnableIRQ(i2cErIrqNum[idx]);
+
+		I2cHdlrDmaInit(idx, &i2cHdlrInst[idx].dmaTx, &i2cDmaTxCfg[idx], DMA_MEMORY_TO_PERIPH);
+		I2cHdlrDmaInit(idx, &i2cHdlrInst[idx].dmaRx, &i2cDmaRxCfg[idx], DMA_PERIPH_TO_MEMORY);
+		i2cHdlrInst[idx].dmaTx.XferCpltCallback = I2cHdlrDmaTxCplt;
+		i2cHdlrInst[idx].dmaRx.XferCpltCallback = I2cHdlrDmaRxCplt;
+    }
+
+    PRINT_DEBUG("[I2c]: Initialization completed\r\n");
+}
+
+static void I2cHdlrGpioClkEnable (GPIO_TypeDef *port)
+{
+	/* GPIOA..GPIOH are 0x400 apart and enabled by AHB1ENR bits 0..7 */
+	uint32_t portIdx = (uint32_t)(((uintptr_t)port - GPIOA_BASE) / 0x400u);
+	volatile uint32_t tmpreg;
+
+	RCC->AHB1ENR |= (1u << portIdx);
+	/* Delay after an RCC peripheral clock enabling */
+	tmpreg = RCC->AHB1ENR;
+	(void)tmpreg;
+}
+
+static void I2cHdlrPinInit (tI2cHdlrModIdx devIdx)
+{
+	const tI2cHdlrBusCfg *busCfg = &i2cHdlrBusCfg[devIdx];
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	switch (devIdx)
+	{
+		case I2C_HDLR_MOD1:
+			__HAL_RCC_I2C1_CLK_ENABLE();
+			break;
+
+		case I2C_HDLR_MOD2:
+			__HAL_RCC_I2C2_CLK_ENABLE();
+			break;
+
+		case I2C_HDLR_MOD3:
+			__HAL_RCC_I2C3_CLK_ENABLE();
+			break;
+
+		default:
+			break;
+	}
+
+	I2cHdlrGpioClkEnable(busCfg->sclPort);
+	I2cHdlrGpioClkEnable(busCfg->sdaPort);
+
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Alternate = busCfg->alternate;
+	GPIO_InitStruct.Pin = busCfg->sclPin;
+	HAL_GPIO_Init(busCfg->sclPort, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = busCfg->sdaPin;
+	HAL_GPIO_Init(busCfg->sdaPort, &GPIO_InitStruct);
+}
+
+static I2cHdlrErrCode I2cHdlrCalcTiming (tI2cHdlrSpeed speed, uint32_t *freq, uint32_t *ccr, uint32_t *trise)
+{
+	I2cHdlrErrCode result = I2C_HDLR_OK;
+	const tI2cHdlrSpeedCfg *cfg = &i2cSpeedCfg[speed];
+	uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+	uint32_t busPeriodDiv = cfg->busFreq * cfg->periodUnits;
+
+	*freq = pclk1 / 1000000u;
+	/* Rounded up, the bus never runs faster than requested */
+	*ccr = (pclk1 + busPeriodDiv - 1u) / busPeriodDiv;
+	*trise = ((*freq * cfg->riseTimeNs) / 1000u) + 1u;
+
+	if ( (*freq < I2C_HDLR_FREQ_MIN_MHZ) || (*freq > I2C_HDLR_FREQ_MAX_MHZ) ||
+		 (*ccr < cfg->ccrMin) || (*ccr > I2C_HDLR_CCR_MASK) )
+	{
+		result = I2C_HDLR_ERR;
+	}
+	*ccr |= cfg->ccrFlags;
+
+	return result;
+}
+
+static void I2cHdlrHwInit (tI2cHdlrModIdx devIdx)
+{
+	uint32_t freq;
+	uint32_t ccr;
+	uint32_t trise;
+
+	if (I2cHdlrCalcTiming(i2cHdlrInst[devIdx].speed, &freq, &ccr, &trise) != I2C_HDLR_OK)
+	{
+		/* PCLK1 too slow for the requested speed, fall back to standard mode */
+		i2cHdlrInst[devIdx].speed = I2C_HDLR_SPEED_100K;
+		I2cHdlrCalcTiming(I2C_HDLR_SPEED_100K, &freq, &ccr, &trise);
+	}
+
+	I2cHdlrSetReset(i2cHdlrInst[devIdx].regMap);
+	I2cHdlrClrReset(i2cHdlrInst[devIdx].regMap);
+	I2cHdlrSetClockFreq(i2cHdlrInst[devIdx].regMap, freq);
+	I2cHdlrSetTRise(i2cHdlrInst[devIdx].regMap, trise);
+	I2cHdlrSetClockConf(i2cHdlrInst[devIdx].regMap, ccr);
+	I2cHdlrSetOAR1(i2cHdlrInst[devIdx].regMap, 0x4000);
+
+	I2cHdlrEnablePeri(i2cHdlrInst[devIdx].regMap);
+	i2cHdlrInst[devIdx].stopWaitCycles = (HAL_RCC_GetHCLKFreq() / i2cSpeedCfg[i2cHdlrInst[devIdx].speed].busFreq) *
+										 I2C_HDLR_STOP_WAIT_PERIODS;
+	i2cHdlrInst[devIdx].isClockDirty = FALSE;
+}
+
+void I2cHdlrRun (void)
+{
+    static int idx = 0u;
+    I2cHdlrErrCode trResult;
+    uint32_t now = DWT->CYCCNT;
+    uint32_t elapsed = now - statsLastRun;
+
+    statsLastRun = now;
+
+    for (idx=0; idx<I2C_HDLR_MOD_NUM; idx++)
+    {
+		if (i2cHdlrBusCfg[idx].isEnabled != TRUE)
+		{
+			continue;
+		}
+
+		/* Observation window for the utilisation, immune to CYCCNT wrap */
+		i2cHdlrInst[idx].stats.windowCycles += elapsed;
+
+		I2cHdlrCheckTimeout(idx);
+
+		switch (i2cHdlrInst[idx].fsmsts)
+		{
+			case I2C_HDLR_INIT:
+				/* Start with the initialization */
+				/* Copy here */
+				i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
+				break;
+
+			case I2C_HDLR_IDLE:
+				if (i2cHdlrInst[idx].isClockDirty == TRUE)
+				{
+					I2cHdlrHwInit(idx);
+				}
+				I2cHdlrDispatch(idx);
+				break;
+
+			case I2C_HDLR_DATATX:
+				if (i2cHdlrInst[idx].backend != I2C_HDLR_BACKEND_POLL)
+				{
+					/* Start deferred by a pending stop, the ISR does the rest */
+					I2cHdlrIrqStart(idx);
+					break;
+				}
+				trResult = I2cHdlrTxRun(idx);
+				if ( (trResult == I2C_HDLR_OK) || (trResult == I2C_HDLR_ERR) )
+				{
+					i2cHdlrInst[idx].fsmtxsts = I2C_HDLR_TX_IDLE;
+					I2cHdlrTrDone(idx, trResult);
+				}
+
+				break;
+
+			case I2C_HDLR_DATARX:
+				if (i2cHdlrInst[idx].backend != I2C_HDLR_BACKEND_POLL)
+				{
+					/* Start deferred by a pending stop, the ISR does the rest */
+					I2cHdlrIrqStart(idx);
+					break;
+				}
+				trResult = I2cHdlrRxRun(idx);
+				if ( (trResult == I2C_HDLR_OK) || (trResult == I2C_HDLR_ERR) )
+				{
+					i2cHdlrInst[idx].fsmrxsts = I2C_HDLR_RX_IDLE;
+					I2cHdlrTrDone(idx, trResult);
+				}
+
+				break;
+
+			case I2C_HDLR_BACKOFF:
+				if (isTimerExpired(i2cHdlrInst[idx].backoff))
+				{
+					i2cHdlrInst[idx].fsmsts = I2C_HDLR_IDLE;
+					I2cHdlrDispatch(idx);
+				}
+				break;
+
+		}
+    }
+
+}
+
+I2cHdlrErrCode I2cHdlrTxRun (tI2cHdlrModIdx devIdx)
+{
+	I2cHdlrErrCode result = I2C_HDLR_BUSY;
+	uint16_t tempreg;
+
+	switch (i2cHdlrInst[devIdx].fsmtxsts)
+	{
+		case I2C_HDLR_TX_IDLE:
+			result = I2C_HDLR_OK;
+			break;
+
+		case I2C_HDLR_TX_STARTTX:
+		    I2cHdlrEnableAck(i2cHdlrInst[devIdx].regMap);
+            /* Generate Start condition */
+			I2cHdlrSendStart(i2cHdlrInst[devIdx].regMap);
+            /* Wait start condition generation detection */
+			i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDADDR;
+            /* Send address */
+            break;
+
+		case I2C_HDLR_TX_SENDADDR:
+			/* Check if start condition has been sent */
+			if (I2cHdlrIsStartSent(i2cHdlrInst[devIdx].regMap))
+			{
+				I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, i2cHdlrInst[devIdx].currTr.addr);
+				/* Wait address sent condition generation detection */
+				i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_CHECKADDR;
+			}
+			break;
+
+		case I2C_HDLR_TX_CHECKADDR:
+			/* Check if address has been sent */
+			if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap) && !I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
+			{
+				/* Nobody answered, ADDR is never set */
+				I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+				I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
+				i2cHdlrInst[devIdx].stats.nackCnt++;
+				I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_ADDR_NACK);
+
+				result = I2C_HDLR_ERR;
+			}
+			else if (I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
+			{
+				/* This sequence, cleares the ADDR bit */
+				/* To be macrofied */
+				tempreg = i2cHdlrInst[devIdx].regMap->SR1;
+				tempreg = i2cHdlrInst[devIdx].regMap->SR2;
+				(void)tempreg;
+
+				/* Check of NAK */
+				if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap))
+				{
+					/* Generate Stop */
+					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+					/* Cleat ack failure */
+					I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
+					i2cHdlrInst[devIdx].stats.nackCnt++;
+					I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_ADDR_NACK);
+
+					result = I2C_HDLR_ERR;
+				}
+				i2cHdlrInst[devIdx].currTr.currPos = 0u;
+				/* Wait address sent condition generation detection */
+				i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA;
+
+            }
+			break;
+
+		case I2C_HDLR_TX_SENDDATA:
+            /* Send data */
+			I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, i2cHdlrInst[devIdx].currTr.pData[i2cHdlrInst[devIdx].currTr.currPos]);
+			i2cHdlrInst[devIdx].currTr.currPos++;
+			i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA_WAIT;
+			break;
+
+		case I2C_HDLR_TX_SENDDATA_WAIT:
+
+			if(!I2cHdlrIsTxRegEmpty(i2cHdlrInst[devIdx].regMap))
+			{
+				/* Wait TXE to be set*/
+				if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap))
+				{
+					/* Generate Stop */
+					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+					/* Cleat ack failure */
+					I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
+					i2cHdlrInst[devIdx].stats.nackCnt++;
+					I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_DATA_NACK);
+
+					result = I2C_HDLR_ERR;
+
+				}
+			}
+			else
+			{
+				if ( (i2cHdlrInst[devIdx].currTr.currPos == i2cHdlrInst[devIdx].currTr.length) &&
+					 (i2cHdlrInst[devIdx].currTr.rxLength != 0u) )
+				{
+					/* Write phase done, continue with the read phase */
+					I2cHdlrRestartRx(devIdx);
+				}
+				else if (i2cHdlrInst[devIdx].currTr.currPos == i2cHdlrInst[devIdx].currTr.length)
+				{
+					result = I2C_HDLR_OK;
+					/* Data transfer is finished */
+					i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_IDLE;
+					/* Generate Stop */
+					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+				}
+				else
+				{
+					i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDDATA;
+				}
+			}
+			break;
+	}
+
+	return result;
+}
+
+I2cHdlrErrCode I2cHdlrRxRun (tI2cHdlrModIdx devIdx)
+{
+	I2cHdlrErrCode result = I2C_HDLR_BUSY;
+	uint16_t tempreg;
+
+	switch (i2cHdlrInst[devIdx].fsmrxsts)
+	{
+		case I2C_HDLR_RX_IDLE:
+			result = I2C_HDLR_OK;
+			break;
+
+		case I2C_HDLR_RX_STARTRX:
+		    I2cHdlrEnableAck(i2cHdlrInst[devIdx].regMap);
+            /* Generate Start condition */
+			I2cHdlrSendStart(i2cHdlrInst[devIdx].regMap);
+            /* Wait start condition generation detection */
+			i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_SENDADDR;
+            /* Send address */
+            break;
+
+		case I2C_HDLR_RX_SENDADDR:
+			/* Check if start condition has been sent */
+			if (I2cHdlrIsStartSent(i2cHdlrInst[devIdx].regMap))
+			{
+				I2cHdlrSendData(i2cHdlrInst[devIdx].regMap, (i2cHdlrInst[devIdx].currTr.addr | 0x01));
+				/* Wait address sent condition generation detection */
+				i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_CHECKADDR;
+			}
+			break;
+
+		case I2C_HDLR_RX_CHECKADDR:
+			/* Check if address has been sent */
+			if (I2cHdlrIsNackRec(i2cHdlrInst[devIdx].regMap) && !I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
+			{
+				/* Nobody answered, ADDR is never set */
+				I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+				I2cHdlrClrNack(i2cHdlrInst[devIdx].regMap);
+				i2cHdlrInst[devIdx].stats.nackCnt++;
+				I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_ADDR_NACK);
+
+				result = I2C_HDLR_ERR;
+			}
+			else if (I2cHdlrIsAddrSent(i2cHdlrInst[devIdx].regMap))
+			{
+				if (i2cHdlrInst[devIdx].currTr.length == 1u)
+				{
+					/* A Nack must be set for the last byte to stop comm */
+					I2cHdlrDisableAck(i2cHdlrInst[devIdx].regMap);
+				}
+
+				/* This sequence, cleares the ADDR bit */
+				/* To be macrofied */
+				tempreg = i2cHdlrInst[devIdx].regMap->SR1;
+				tempreg = i2cHdlrInst[devIdx].regMap->SR2;
+				(void)tempreg;
+
+				if (i2cHdlrInst[devIdx].currTr.length == 1u)
+				{
+					/* Generate Stop */
+					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+				}
+
+				i2cHdlrInst[devIdx].currTr.currPos = 0u;
+				/* Wait address sent condition generation detection */
+				i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_RECDATA;
+
+            }
+			break;
+
+		case I2C_HDLR_RX_RECDATA:
+            if(I2cHdlrIsRxRegNotEmpty(i2cHdlrInst[devIdx].regMap))
+            {
+            	i2cHdlrInst[devIdx].currTr.pData[i2cHdlrInst[devIdx].currTr.currPos] = I2cHdlrReceiveData(i2cHdlrInst[devIdx].regMap);
+            	i2cHdlrInst[devIdx].currTr.currPos++;
+
+				if (i2cHdlrInst[devIdx].currTr.currPos == i2cHdlrInst[devIdx].currTr.length)
+				{
+					result = I2C_HDLR_OK;
+					/* Data transfer is finished */
+					i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_IDLE;
+				}
+				else if(i2cHdlrInst[devIdx].currTr.currPos == (i2cHdlrInst[devIdx].currTr.length - 1u))
+				{
+					/* A Nack must be set for the last byte to stop comm */
+					I2cHdlrDisableAck(i2cHdlrInst[devIdx].regMap);
+					/* Generate Stop */
+					I2cHdlrSendStop(i2cHdlrInst[devIdx].regMap);
+				}
+            }
+			break;
+
+		case I2C_HDLR_RX_RECDATA_WAIT:
+			/* DMA reception only, ended by the interrupts */
+			break;
+	}
+
+	return result;
+}
+
+boolean I2cHdlrIsFsmBusy (tI2cHdlrModIdx devIdx)
+{
+	boolean isBusy = TRUE;
+
+	if ( (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_IDLE) &&
+		 (i2cHdlrInst[devIdx].queueHead == i2cHdlrInst[devIdx].queueTail) )
+	{
+		isBusy = FALSE;
+	}
+
+	return isBusy;
+}
+
+uint32_t I2cHdlrGetQueueFree (tI2cHdlrModIdx devIdx)
+{
+	return I2C_HDLR_QUEUE_LEN - (uint8_t)(i2cHdlrInst[devIdx].queueHead - i2cHdlrInst[devIdx].queueTail);
+}
+
+/* Interrupts masked by the caller, completion callbacks may enqueue too */
+static void I2cHdlrLink (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+
+	if (tr->pStatus != NULL)
+	{
+		*tr->pStatus = I2C_HDLR_TR_PENDING;
+	}
+	inst->queue[inst->queueHead & (I2C_HDLR_QUEUE_LEN - 1u)] = *tr;
+	inst->queueStamp[inst->queueHead & (I2C_HDLR_QUEUE_LEN - 1u)] = DWT->CYCCNT;
+	inst->queueHead++;
+}
+
+I2cHdlrErrCode I2cHdlrEnqueue (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr)
+{
+	I2cHdlrErrCode result = I2C_HDLR_BUSY;
+	uint32_t primask;
+
+	if (i2cHdlrBusCfg[devIdx].isEnabled != TRUE)
+	{
+		result = I2C_HDLR_ERR;
+	}
+	else
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (I2cHdlrGetQueueFree(devIdx) > 0u)
+		{
+			I2cHdlrLink(devIdx, tr);
+			result = I2C_HDLR_OK;
+		}
+		__set_PRIMASK(primask);
+
+		if (result == I2C_HDLR_OK)
+		{
+			I2cHdlrDispatch(devIdx);
+		}
+	}
+
+	return result;
+}
+
+I2cHdlrErrCode I2cHdlrMasterTx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length)
+{
+	tI2cHdlrTr tr = {0};
+
+	tr.addr = addr;
+	tr.retries = I2C_HDLR_RETRIES_DEFAULT;
+	tr.pTxData = data;
+	tr.txLength = length;
+
+	return I2cHdlrEnqueue(devIdx, &tr);
+}
+
+I2cHdlrErrCode I2cHdlrMasterRx (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *data, uint16_t length)
+{
+	tI2cHdlrTr tr = {0};
+
+	tr.addr = addr;
+	tr.retries = I2C_HDLR_RETRIES_DEFAULT;
+	tr.pRxData = data;
+	tr.rxLength = length;
+
+	return I2cHdlrEnqueue(devIdx, &tr);
+}
+
+I2cHdlrErrCode I2cHdlrMasterWriteRead (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *txData, uint16_t txLength, uint8_t *rxData, uint16_t rxLength)
+{
+	tI2cHdlrTr tr = {0};
+
+	tr.addr = addr;
+	tr.retries = I2C_HDLR_RETRIES_DEFAULT;
+	tr.pTxData = txData;
+	tr.txLength = txLength;
+	tr.pRxData = rxData;
+	tr.rxLength = rxLength;
+
+	return I2cHdlrEnqueue(devIdx, &tr);
+}
+
+/*
+ * Packs the rows into write bursts, a row whose register follows the previous
+ * row's last one is appended to the same burst and relies on the device
+ * register auto-increment. Rows are kept in table order, only adjacent rows
+ * are merged. buff must hold I2C_HDLR_CFG_BUFF_LEN(regNum) bytes and bursts
+ * regNum entries, the number of bursts is returned.
+ */
+uint32_t I2cHdlrCfgMerge (const tI2cHdlrRegCfg *regs, uint32_t regNum, uint8_t *buff, tI2cHdlrBurst *bursts)
+{
+	uint32_t burstNum = 0u;
+	uint32_t pos = 0u;
+	uint32_t idx;
+	uint32_t nextReg = 0u;
+
+	for (idx = 0u; idx < regNum; idx++)
+	{
+		if ( (burstNum == 0u) || (regs[idx].reg != nextReg) )
+		{
+			bursts[burstNum].pData = &buff[pos];
+			bursts[burstNum].length = 1u;
+			buff[pos] = regs[idx].reg;
+			pos++;
+			burstNum++;
+		}
+
+		memcpy(&buff[pos], regs[idx].value, regs[idx].length);
+		pos += regs[idx].length;
+		bursts[burstNum - 1u].length += regs[idx].length;
+		nextReg = regs[idx].reg + regs[idx].length;
+	}
+
+	return burstNum;
+}
+
+/* Queues all the bursts or none of them, pStatus gets the first failure once the last one is done */
+I2cHdlrErrCode I2cHdlrCfgLoad (tI2cHdlrModIdx devIdx, uint8_t addr, const tI2cHdlrBurst *bursts, uint32_t burstNum, volatile tI2cHdlrTrStatus *pStatus)
+{
+	I2cHdlrErrCode result = I2C_HDLR_BUSY;
+	tI2cHdlrTr tr = {0};
+	uint32_t primask;
+	uint32_t idx;
+
+	if (burstNum == 0u)
+	{
+		if (pStatus != NULL)
+		{
+			*pStatus = I2C_HDLR_TR_OK;
+		}
+		result = I2C_HDLR_OK;
+	}
+	else if (i2cHdlrBusCfg[devIdx].isEnabled != TRUE)
+	{
+		result = I2C_HDLR_ERR;
+	}
+	else
+	{
+		tr.addr = addr;
+		tr.retries = I2C_HDLR_RETRIES_DEFAULT;
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (I2cHdlrGetQueueFree(devIdx) >= burstNum)
+		{
+			for (idx = 0u; idx < burstNum; idx++)
+			{
+				tr.pTxData = bursts[idx].pData;
+				tr.txLength = bursts[idx].length;
+				tr.pStatus = pStatus;
+				tr.chainLeft = (uint8_t)(burstNum - 1u - idx);
+				I2cHdlrLink(devIdx, &tr);
+			}
+			result = I2C_HDLR_OK;
+		}
+		__set_PRIMASK(primask);
+
+		if (result == I2C_HDLR_OK)
+		{
+			I2cHdlrDispatch(devIdx);
+		}
+	}
+
+	return result;
+}
+
+I2cHdlrErrCode I2cHdlrShadowAttach (tI2cHdlrModIdx devIdx, tI2cHdlrShadow *shadow)
+{
+	I2cHdlrErrCode result = I2C_HDLR_ERR;
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+
+	if (inst->shadowNum < I2C_HDLR_SHADOW_MAX)
+	{
+		/* Nothing is known until the first write or read */
+		memset(shadow->validMap, 0, I2C_HDLR_SHADOW_MAP_LEN(shadow->regNum));
+		inst->shadow[inst->shadowNum] = shadow;
+		inst->shadowNum++;
+		result = I2C_HDLR_OK;
+	}
+
+	return result;
+}
+
+static tI2cHdlrShadow *I2cHdlrShadowFind (tI2cHdlrModIdx devIdx, uint8_t addr)
+{
+	tI2cHdlrShadow *shadow = NULL;
+	uint32_t idx;
+
+	for (idx = 0u; idx < i2cHdlrInst[devIdx].shadowNum; idx++)
+	{
+		if (i2cHdlrInst[devIdx].shadow[idx]->addr == addr)
+		{
+			shadow = i2cHdlrInst[devIdx].shadow[idx];
+			break;
+		}
+	}
+
+	return shadow;
+}
+
+/* Called with a completed transaction, the first written byte is the register address */
+static void I2cHdlrShadowUpdate (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr)
+{
+	tI2cHdlrShadow *shadow = I2cHdlrShadowFind(devIdx, tr->addr);
+	const uint8_t *pData = tr->pRxData;
+	uint32_t length = tr->rxLength;
+	uint32_t reg;
+	uint32_t idx;
+
+	if ( (shadow != NULL) && (tr->txLength != 0u) )
+	{
+		reg = tr->pTxData[0];
+		if (tr->rxLength == 0u)
+		{
+			/* Plain write, the data follows the register address */
+			pData = &tr->pTxData[1];
+			length = tr->txLength - 1u;
+		}
+
+		for (idx = 0u; (idx < length) && (reg < shadow->regNum); idx++, reg++)
+		{
+			shadow->value[reg] = pData[idx];
+			if ((shadow->volatileMap[reg >> 3] & (1u << (reg & 7u))) == 0u)
+			{
+				shadow->validMap[reg >> 3] |= (1u << (reg & 7u));
+			}
+		}
+	}
+}
+
+/*
+ * Register read served from the shadow when every register of the range is
+ * cached and known, the status is then final on return. Otherwise it is a
+ * write-read on the bus, reg must stay valid until it completes.
+ */
+I2cHdlrErrCode I2cHdlrRegRead (tI2cHdlrModIdx devIdx, uint8_t addr, uint8_t *reg, uint8_t *data, uint16_t length, volatile tI2cHdlrTrStatus *pStatus)
+{
+	I2cHdlrErrCode result;
+	tI2cHdlrShadow *shadow = I2cHdlrShadowFind(devIdx, addr);
+	tI2cHdlrTr tr = {0};
+	boolean isCached = FALSE;
+	uint32_t idx;
+
+	if ( (shadow != NULL) && (((uint32_t)*reg + length) <= shadow->regNum) )
+	{
+		isCached = TRUE;
+		for (idx = *reg; idx < ((uint32_t)*reg + length); idx++)
+		{
+			if ((shadow->validMap[idx >> 3] & (1u << (idx & 7u))) == 0u)
+			{
+				isCached = FALSE;
+			}
+		}
+	}
+
+	if (isCached == TRUE)
+	{
+		memcpy(data, &shadow->value[*reg], length);
+		if (pStatus != NULL)
+		{
+			*pStatus = I2C_HDLR_TR_OK;
+		}
+		result = I2C_HDLR_OK;
+	}
+	else
+	{
+		tr.addr = addr;
+		tr.pTxData = reg;
+		tr.txLength = 1u;
+		tr.pRxData = data;
+		tr.rxLength = length;
+		tr.pStatus = pStatus;
+		tr.retries = I2C_HDLR_RETRIES_DEFAULT;
+		result = I2cHdlrEnqueue(devIdx, &tr);
+	}
+
+	return result;
+}
+
+/*
+ * Starts the queue tail on a free bus, from the main loop as well as from the
+ * completion interrupts. Only the bus is claimed with the interrupts masked,
+ * the start (which may wait for the previous stop) runs with them enabled.
+ */
+static void I2cHdlrDispatch (tI2cHdlrModIdx devIdx)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	tI2cHdlrTr *tr;
+	boolean isClaimed = FALSE;
+	uint32_t primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ( (inst->fsmsts == I2C_HDLR_IDLE) &&
+		 (inst->isClockDirty == FALSE) &&
+		 (inst->queueHead != inst->queueTail) )
+	{
+		tr = &inst->queue[inst->queueTail & (I2C_HDLR_QUEUE_LEN - 1u)];
+
+		inst->busStart = DWT->CYCCNT;
+		inst->trStatus = I2C_HDLR_TR_PENDING;
+		inst->currTr.addr = tr->addr;
+		if (tr->txLength != 0u)
+		{
+			inst->currTr.pData = tr->pTxData;
+			inst->currTr.length = tr->txLength;
+			inst->currTr.pRxData = tr->pRxData;
+			inst->currTr.rxLength = tr->rxLength;
+			inst->fsmtxsts = I2C_HDLR_TX_STARTTX;
+			inst->fsmsts = I2C_HDLR_DATATX;
+		}
+		else
+		{
+			inst->currTr.pData = tr->pRxData;
+			inst->currTr.length = tr->rxLength;
+			inst->currTr.rxLength = 0u;
+			inst->fsmrxsts = I2C_HDLR_RX_STARTRX;
+			inst->fsmsts = I2C_HDLR_DATARX;
+		}
+		isClaimed = TRUE;
+	}
+	__set_PRIMASK(primask);
+
+	if ( (isClaimed == TRUE) && (inst->backend != I2C_HDLR_BACKEND_POLL) )
+	{
+		I2cHdlrIrqStart(devIdx);
+	}
+}
+
+static void I2cHdlrSetFailure (tI2cHdlrModIdx devIdx, tI2cHdlrTrStatus status)
+{
+	/* The first detected cause wins, later flags are consequences of it */
+	if (i2cHdlrInst[devIdx].trStatus == I2C_HDLR_TR_PENDING)
+	{
+		i2cHdlrInst[devIdx].trStatus = status;
+	}
+}
+
+static void I2cHdlrTrDone (tI2cHdlrModIdx devIdx, I2cHdlrErrCode result)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	tI2cHdlrTr *tr = &inst->queue[inst->queueTail & (I2C_HDLR_QUEUE_LEN - 1u)];
+	tI2cHdlrCallback callback = tr->callback;
+	uint32_t token = tr->token;
+	tI2cHdlrTrStatus status = I2C_HDLR_TR_OK;
+
+	inst->stats.busyCycles += DWT->CYCCNT - inst->busStart;
+
+	if (result != I2C_HDLR_OK)
+	{
+		I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_BUS_ERR);
+		status = inst->trStatus;
+	}
+
+	if ( (status != I2C_HDLR_TR_OK) && (inst->retryCnt < tr->retries) )
+	{
+		/* Same descriptor is dispatched again once the backoff expires */
+		TimerSet(&inst->backoff, I2C_HDLR_RETRY_BACKOFF << inst->retryCnt);
+		inst->retryCnt++;
+		inst->stats.retryCnt++;
+		inst->fsmsts = I2C_HDLR_BACKOFF;
+	}
+	else
+	{
+		inst->retryCnt = 0u;
+		inst->lastStatus = status;
+		I2cHdlrStatsAccount(devIdx, tr, status);
+		if (status == I2C_HDLR_TR_OK)
+		{
+			I2cHdlrShadowUpdate(devIdx, tr);
+		}
+
+		if ( (inst->chainStatus == I2C_HDLR_TR_OK) && (status != I2C_HDLR_TR_OK) )
+		{
+			inst->chainStatus = status;
+		}
+		if (tr->chainLeft == 0u)
+		{
+			if (tr->pStatus != NULL)
+			{
+				*tr->pStatus = inst->chainStatus;
+			}
+			inst->chainStatus = I2C_HDLR_TR_OK;
+		}
+
+		/* Slot is released before the callback so that it can enqueue again */
+		inst->queueTail++;
+		inst->fsmsts = I2C_HDLR_IDLE;
+
+		if (callback != NULL)
+		{
+			callback(devIdx, token, status);
+		}
+
+		I2cHdlrDispatch(devIdx);
+	}
+}
+
+static void I2cHdlrStatsAccount (tI2cHdlrModIdx devIdx, const tI2cHdlrTr *tr, tI2cHdlrTrStatus status)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	uint32_t now = DWT->CYCCNT;
+	/* End to end, from the request being queued to its completion */
+	uint32_t latency = now - inst->queueStamp[inst->queueTail & (I2C_HDLR_QUEUE_LEN - 1u)];
+	uint32_t bucket = 31u - __CLZ(latency | 1u);
+
+	inst->stats.trCnt++;
+	if (status == I2C_HDLR_TR_OK)
+	{
+		inst->stats.byteCnt += tr->txLength + tr->rxLength;
+	}
+	else
+	{
+		inst->stats.errCnt++;
+	}
+
+	if (latency > inst->stats.latencyMax)
+	{
+		inst->stats.latencyMax = latency;
+	}
+	inst->stats.latencyHist[bucket]++;
+}
+
+void I2cHdlrGetStats (tI2cHdlrModIdx devIdx, tI2cHdlrStats *stats, boolean isClear)
+{
+	uint32_t primask;
+
+	/* Completions update the counters from interrupt context */
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = i2cHdlrInst[devIdx].stats;
+	if (isClear == TRUE)
+	{
+		memset(&i2cHdlrInst[devIdx].stats, 0, sizeof(tI2cHdlrStats));
+	}
+	__set_PRIMASK(primask);
+}
+
+I2cHdlrErrCode I2cHdlrSetBackend (tI2cHdlrModIdx devIdx, tI2cHdlrBackend backend)
+{
+	I2cHdlrErrCode result = I2C_HDLR_BUSY;
+
+	/* Switching is only allowed between transactions */
+	if (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_IDLE)
+	{
+		i2cHdlrInst[devIdx].backend = backend;
+		result = I2C_HDLR_OK;
+	}
+
+	return result;
+}
+
+#ifdef I2C_HDLR_SIM
+/* Moves a bus onto a simulated register block, only the polled backend is modelled */
+void I2cHdlrSimAttach (tI2cHdlrModIdx devIdx, void *regs)
+{
+	i2cHdlrInst[devIdx].regMap = regs;
+	i2cHdlrInst[devIdx].backend = I2C_HDLR_BACKEND_POLL;
+	I2cHdlrHwInit(devIdx);
+}
+#endif
+
+tI2cHdlrBackend I2cHdlrGetBackend (tI2cHdlrModIdx devIdx)
+{
+	return i2cHdlrInst[devIdx].backend;
+}
+
+I2cHdlrErrCode I2cHdlrSetSpeed (tI2cHdlrModIdx devIdx, tI2cHdlrSpeed speed)
+{
+	I2cHdlrErrCode result;
+	uint32_t freq;
+	uint32_t ccr;
+	uint32_t trise;
+
+	if (i2cHdlrBusCfg[devIdx].isEnabled != TRUE)
+	{
+		result = I2C_HDLR_ERR;
+	}
+	else
+	{
+		result = I2cHdlrCalcTiming(speed, &freq, &ccr, &trise);
+	}
+	if (result == I2C_HDLR_OK)
+	{
+		i2cHdlrInst[devIdx].speed = speed;
+		i2cHdlrInst[devIdx].isClockDirty = TRUE;
+	}
+
+	return result;
+}
+
+tI2cHdlrSpeed I2cHdlrGetSpeed (tI2cHdlrModIdx devIdx)
+{
+	return i2cHdlrInst[devIdx].speed;
+}
+
+uint32_t I2cHdlrGetRecoveryCount (tI2cHdlrModIdx devIdx)
+{
+	return i2cHdlrInst[devIdx].recoveryCnt;
+}
+
+tI2cHdlrTrStatus I2cHdlrGetLastStatus (tI2cHdlrModIdx devIdx)
+{
+	return i2cHdlrInst[devIdx].lastStatus;
+}
+
+/*
+ * Event, error and DMA interrupts of one bus off at the NVIC, the other
+ * buses and the encoder keep theirs. A flag raised meanwhile stays pending
+ * and is served once unmasked.
+ */
+static void I2cHdlrIrqMask (tI2cHdlrModIdx devIdx)
+{
+	HAL_NVIC_DisableIRQ(i2cEvIrqNum[devIdx]);
+	HAL_NVIC_DisableIRQ(i2cErIrqNum[devIdx]);
+	HAL_NVIC_DisableIRQ(i2cDmaTxCfg[devIdx].irqNum);
+	HAL_NVIC_DisableIRQ(i2cDmaRxCfg[devIdx].irqNum);
+}
+
+static void I2cHdlrIrqUnmask (tI2cHdlrModIdx devIdx)
+{
+	HAL_NVIC_EnableIRQ(i2cEvIrqNum[devIdx]);
+	HAL_NVIC_EnableIRQ(i2cErIrqNum[devIdx]);
+	HAL_NVIC_EnableIRQ(i2cDmaTxCfg[devIdx].irqNum);
+	HAL_NVIC_EnableIRQ(i2cDmaRxCfg[devIdx].irqNum);
+}
+
+/* Progress snapshot of the transaction on the bus, 0 when there is none */
+static uint32_t I2cHdlrProgress (tI2cHdlrModIdx devIdx)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	tI2cHdlrFsmSts fsmsts = inst->fsmsts;
+	uint32_t progress = 0u;
+
+	if ( (fsmsts == I2C_HDLR_DATATX) || (fsmsts == I2C_HDLR_DATARX) )
+	{
+		progress = ((uint32_t)fsmsts << 24) | ((uint32_t)inst->fsmtxsts << 16) |
+				   ((uint32_t)inst->fsmrxsts << 8) | inst->currTr.currPos;
+	}
+
+	return progress;
+}
+
+/*
+ * The snapshot runs with the interrupts on, a torn one only re-arms the
+ * deadline. Once the deadline has expired the interrupts of the bus are
+ * masked, the snapshot is taken again and the recovery runs only if the
+ * transaction is still stuck, so the ISRs cannot race the reset.
+ */
+static void I2cHdlrCheckTimeout (tI2cHdlrModIdx devIdx)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	uint32_t progress = I2cHdlrProgress(devIdx);
+
+	if (progress != inst->lastProgress)
+	{
+		inst->lastProgress = progress;
+		TimerSet(&inst->deadline, I2C_HDLR_STATE_TIMEOUT);
+	}
+	else if ( (progress != 0u) && isTimerExpired(inst->deadline) )
+	{
+		I2cHdlrIrqMask(devIdx);
+		if (I2cHdlrProgress(devIdx) == progress)
+		{
+			I2cHdlrRecover(devIdx);
+		}
+		I2cHdlrIrqUnmask(devIdx);
+	}
+}
+
+static void I2cHdlrRecoveryDelay (void)
+{
+	volatile uint32_t loops;
+
+	for (loops = 0u; loops < I2C_HDLR_RECOVERY_DELAY_LOOPS; loops++)
+	{
+	}
+}
+
+/* With the interrupts of the bus masked, see I2cHdlrCheckTimeout() */
+static void I2cHdlrRecover (tI2cHdlrModIdx devIdx)
+{
+	const tI2cHdlrBusCfg *pinCfg = &i2cHdlrBusCfg[devIdx];
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+	uint32_t clk;
+
+	I2cHdlrIrqStop(devIdx);
+	/* Software reset releases the lines from the peripheral side */
+	I2cHdlrSetReset(i2cHdlrInst[devIdx].regMap);
+
+	/* Take the pins as GPIO and clock SCL until the slave releases SDA */
+	HAL_GPIO_WritePin(pinCfg->sclPort, pinCfg->sclPin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(pinCfg->sdaPort, pinCfg->sdaPin, GPIO_PIN_SET);
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Pin = pinCfg->sclPin;
+	HAL_GPIO_Init(pinCfg->sclPort, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = pinCfg->sdaPin;
+	HAL_GPIO_Init(pinCfg->sdaPort, &GPIO_InitStruct);
+
+	for (clk = 0u; clk < I2C_HDLR_RECOVERY_CLOCKS; clk++)
+	{
+		if (HAL_GPIO_ReadPin(pinCfg->sdaPort, pinCfg->sdaPin) == GPIO_PIN_SET)
+		{
+			break;
+		}
+		HAL_GPIO_WritePin(pinCfg->sclPort, pinCfg->sclPin, GPIO_PIN_RESET);
+		I2cHdlrRecoveryDelay();
+		HAL_GPIO_WritePin(pinCfg->sclPort, pinCfg->sclPin, GPIO_PIN_SET);
+		I2cHdlrRecoveryDelay();
+	}
+
+	/* Stop condition: SDA rising while SCL is high */
+	HAL_GPIO_WritePin(pinCfg->sclPort, pinCfg->sclPin, GPIO_PIN_RESET);
+	I2cHdlrRecoveryDelay();
+	HAL_GPIO_WritePin(pinCfg->sdaPort, pinCfg->sdaPin, GPIO_PIN_RESET);
+	I2cHdlrRecoveryDelay();
+	HAL_GPIO_WritePin(pinCfg->sclPort, pinCfg->sclPin, GPIO_PIN_SET);
+	I2cHdlrRecoveryDelay();
+	HAL_GPIO_WritePin(pinCfg->sdaPort, pinCfg->sdaPin, GPIO_PIN_SET);
+	I2cHdlrRecoveryDelay();
+
+	/* Back to the peripheral */
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+	GPIO_InitStruct.Alternate = pinCfg->alternate;
+	GPIO_InitStruct.Pin = pinCfg->sclPin;
+	HAL_GPIO_Init(pinCfg->sclPort, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = pinCfg->sdaPin;
+	HAL_GPIO_Init(pinCfg->sdaPort, &GPIO_InitStruct);
+
+	I2cHdlrHwInit(devIdx);
+
+	i2cHdlrInst[devIdx].recoveryCnt++;
+	sprintf(debugLocalStr, "[I2c]: Bus %d recovered (%u)\r\n", devIdx + 1,
+			(unsigned int)i2cHdlrInst[devIdx].recoveryCnt);
+	PRINT_DEBUG(debugLocalStr);
+
+	/* The stuck transaction fails, the queue goes on */
+	I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_TIMEOUT);
+	i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_IDLE;
+	i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_IDLE;
+	I2cHdlrTrDone(devIdx, I2C_HDLR_ERR);
+}
+
+/*
+ * Chained from the completion interrupt, the previous stop is usually still
+ * on the wire: the F4 master has no event for its end, so STOP is polled for
+ * at most I2C_HDLR_STOP_WAIT_PERIODS SCL periods and the next start follows
+ * at wire speed. Past that the start is left to the next I2cHdlrRun() pass,
+ * the bus stays busy meanwhile and the progress watchdog covers a stop that
+ * never ends.
+ */
+static void I2cHdlrIrqStart (tI2cHdlrModIdx devIdx)
+{
+	tI2cRegMap *regMap = i2cHdlrInst[devIdx].regMap;
+	boolean isStartDue = ( (i2cHdlrInst[devIdx].fsmtxsts == I2C_HDLR_TX_STARTTX) ||
+						   (i2cHdlrInst[devIdx].fsmrxsts == I2C_HDLR_RX_STARTRX) ) ? TRUE : FALSE;
+	uint32_t start = DWT->CYCCNT;
+
+	while ( (isStartDue == TRUE) && I2cHdlrIsStopPending(regMap) &&
+			((DWT->CYCCNT - start) < i2cHdlrInst[devIdx].stopWaitCycles) )
+	{
+	}
+
+	/* Start is generated only once and not while the previous stop is on the wire */
+	if ( (isStartDue == TRUE) && (!I2cHdlrIsStopPending(regMap)) )
+	{
+		if (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_DATATX)
+		{
+			i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_SENDADDR;
+		}
+		else
+		{
+			i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_SENDADDR;
+		}
+		i2cHdlrInst[devIdx].currTr.currPos = 0u;
+		i2cHdlrInst[devIdx].currTr.isDma = FALSE;
+		if ( (i2cHdlrInst[devIdx].backend == I2C_HDLR_BACKEND_DMA) &&
+			 (i2cHdlrInst[devIdx].currTr.length >= I2C_HDLR_DMA_THRESHOLD) )
+		{
+			i2cHdlrInst[devIdx].currTr.isDma = TRUE;
+		}
+
+		I2cHdlrEnableAck(regMap);
+		I2cHdlrEnableIrq(regMap);
+		/* Generate Start condition, the sequence continues in the event interrupt */
+		I2cHdlrSendStart(regMap);
+	}
+}
+
+static void I2cHdlrRestartRx (tI2cHdlrModIdx devIdx)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+
+	inst->currTr.pData = inst->currTr.pRxData;
+	inst->currTr.length = inst->currTr.rxLength;
+	inst->currTr.rxLength = 0u;
+	inst->currTr.currPos = 0u;
+	inst->currTr.isDma = FALSE;
+	if ( (inst->backend == I2C_HDLR_BACKEND_DMA) &&
+		 (inst->currTr.length >= I2C_HDLR_DMA_THRESHOLD) )
+	{
+		inst->currTr.isDma = TRUE;
+	}
+
+	inst->fsmtxsts = I2C_HDLR_TX_IDLE;
+	inst->fsmrxsts = I2C_HDLR_RX_SENDADDR;
+	inst->fsmsts = I2C_HDLR_DATARX;
+
+	I2cHdlrEnableAck(inst->regMap);
+	if (inst->backend != I2C_HDLR_BACKEND_POLL)
+	{
+		/* Buffer interrupt may have been disabled by the write phase */
+		I2cHdlrEnableIrq(inst->regMap);
+	}
+	/* Repeated start, no stop between the two phases */
+	I2cHdlrSendStart(inst->regMap);
+}
+
+static void I2cHdlrIrqStop (tI2cHdlrModIdx devIdx)
+{
+	I2cHdlrDisableIrq(i2cHdlrInst[devIdx].regMap);
+	if (i2cHdlrInst[devIdx].currTr.isDma == TRUE)
+	{
+		/* No-op when the stream has already completed */
+		I2cHdlrDisableDma(i2cHdlrInst[devIdx].regMap);
+		HAL_DMA_Abort_IT(&i2cHdlrInst[devIdx].dmaTx);
+		HAL_DMA_Abort_IT(&i2cHdlrInst[devIdx].dmaRx);
+		i2cHdlrInst[devIdx].currTr.isDma = FALSE;
+	}
+}
+
+static void I2cHdlrIrqComplete (tI2cHdlrModIdx devIdx, I2cHdlrErrCode result)
+{
+	I2cHdlrIrqStop(devIdx);
+	i2cHdlrInst[devIdx].fsmtxsts = I2C_HDLR_TX_IDLE;
+	i2cHdlrInst[devIdx].fsmrxsts = I2C_HDLR_RX_IDLE;
+	I2cHdlrTrDone(devIdx, result);
+}
+
+void I2cHdlrEvIrqHandler (tI2cHdlrModIdx devIdx)
+{
+	tI2cHdlrInstance *inst = &i2cHdlrInst[devIdx];
+	tI2cRegMap *regMap = inst->regMap;
+	uint32_t sr1 = regMap->SR1;
+	uint16_t tempreg;
+
+	if ((sr1 & I2C_HDLR_SR1_SB) != 0u)
+	{
+		if (inst->fsmsts == I2C_HDLR_DATATX)
+		{
+			I2cHdlrSendData(regMap, inst->currTr.addr);
+			inst->fsmtxsts = I2C_HDLR_TX_CHECKADDR;
+		}
+		else
+		{
+			I2cHdlrSendData(regMap, (inst->currTr.addr | 0x01));
+			inst->fsmrxsts = I2C_HDLR_RX_CHECKADDR;
+		}
+	}
+	else if ( ((sr1 & I2C_HDLR_SR1_ADDR) != 0u) && (inst->currTr.isDma == TRUE) )
+	{
+		if (inst->fsmsts == I2C_HDLR_DATATX)
+		{
+			HAL_DMA_Start_IT(&inst->dmaTx, (uint32_t)(uintptr_t)inst->currTr.pData, (uint32_t)(uintptr_t)&regMap->DR, inst->currTr.length);
+			inst->fsmtxsts = I2C_HDLR_TX_SENDDATA_WAIT;
+		}
+		else
+		{
+			/* With LAST set the peripheral Nacks the byte of the final DMA request */
+			HAL_DMA_Start_IT(&inst->dmaRx, (uint32_t)(uintptr_t)&regMap->DR, (uint32_t)(uintptr_t)inst->currTr.pData, inst->currTr.length);
+			I2cHdlrSetDmaLast(regMap);
+			inst->fsmrxsts = I2C_HDLR_RX_RECDATA_WAIT;
+		}
+		I2cHdlrDisableBufIrq(regMap);
+		I2cHdlrEnableDma(regMap);
+
+		/* SR1 has already been read, reading SR2 clears the ADDR bit */
+		tempreg = regMap->SR2;
+		(void)tempreg;
+	}
+	else if ((sr1 & I2C_HDLR_SR1_ADDR) != 0u)
+	{
+		if ( (inst->fsmsts == I2C_HDLR_DATARX) && (inst->currTr.length == 1u) )
+		{
+			/* A Nack must be set for the last byte to stop comm */
+			I2cHdlrDisableAck(regMap);
+		}
+
+		/* SR1 has already been read, reading SR2 clears the ADDR bit */
+		tempreg = regMap->SR2;
+		(void)tempreg;
+
+		if (inst->fsmsts == I2C_HDLR_DATATX)
+		{
+			inst->fsmtxsts = I2C_HDLR_TX_SENDDATA;
+		}
+		else
+		{
+			if (inst->currTr.length == 1u)
+			{
+				I2cHdlrSendStop(regMap);
+			}
+			inst->fsmrxsts = I2C_HDLR_RX_RECDATA;
+		}
+	}
+	else if (inst->fsmsts == I2C_HDLR_DATATX)
+	{
+		if ( ((sr1 & I2C_HDLR_SR1_TXE) != 0u) &&
+			 (inst->currTr.isDma == FALSE) &&
+			 (inst->currTr.currPos < inst->currTr.length) )
+		{
+			I2cHdlrSendData(regMap, inst->currTr.pData[inst->currTr.currPos]);
+			inst->currTr.currPos++;
+			if (inst->currTr.currPos == inst->currTr.length)
+			{
+				/* Last byte loaded, wait BTF before the stop */
+				I2cHdlrDisableBufIrq(regMap);
+				inst->fsmtxsts = I2C_HDLR_TX_SENDDATA_WAIT;
+			}
+		}
+		else if ( ((sr1 & I2C_HDLR_SR1_BTF) != 0u) &&
+				  (inst->currTr.currPos == inst->currTr.length) )
+		{
+			if (inst->currTr.rxLength != 0u)
+			{
+				I2cHdlrRestartRx(devIdx);
+			}
+			else
+			{
+				I2cHdlrSendStop(regMap);
+				I2cHdlrIrqComplete(devIdx, I2C_HDLR_OK);
+			}
+		}
+	}
+	else if (inst->fsmsts == I2C_HDLR_DATARX)
+	{
+		if ( ((sr1 & I2C_HDLR_SR1_RXNE) != 0u) && (inst->currTr.isDma == FALSE) )
+		{
+			inst->currTr.pData[inst->currTr.currPos] = I2cHdlrReceiveData(regMap);
+			inst->currTr.currPos++;
+
+			if (inst->currTr.currPos == inst->currTr.length)
+			{
+				I2cHdlrIrqComplete(devIdx, I2C_HDLR_OK);
+			}
+			else if (inst->currTr.currPos == (inst->currTr.length - 1u))
+			{
+				/* A Nack must be set for the last byte to stop comm */
+				I2cHdlrDisableAck(regMap);
+				I2cHdlrSendStop(regMap);
+			}
+		}
+	}
+	else
+	{
+		/* Spurious event outside a transaction */
+		I2cHdlrDisableIrq(regMap);
+	}
+}
+
+void I2cHdlrErIrqHandler (tI2cHdlrModIdx devIdx)
+{
+	tI2cRegMap *regMap = i2cHdlrInst[devIdx].regMap;
+	uint32_t sr1 = regMap->SR1;
+
+	if ((sr1 & I2C_HDLR_SR1_ARLO) != 0u)
+	{
+		/* Another master won, the peripheral is already back in slave mode */
+		I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_ARB_LOST);
+	}
+	else if ((sr1 & I2C_HDLR_SR1_AF) != 0u)
+	{
+		/* Release the bus after a Nack */
+		I2cHdlrSendStop(regMap);
+		i2cHdlrInst[devIdx].stats.nackCnt++;
+		if ( (i2cHdlrInst[devIdx].fsmtxsts == I2C_HDLR_TX_CHECKADDR) ||
+			 (i2cHdlrInst[devIdx].fsmrxsts == I2C_HDLR_RX_CHECKADDR) )
+		{
+			I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_ADDR_NACK);
+		}
+		else
+		{
+			I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_DATA_NACK);
+		}
+	}
+	else
+	{
+		/* Misplaced start/stop or overrun */
+		I2cHdlrSetFailure(devIdx, I2C_HDLR_TR_BUS_ERR);
+	}
+
+	/* Error flags are cleared by writing 0 */
+	regMap->SR1 = ~(sr1 & I2C_HDLR_SR1_ERRMASK) & 0xFFFFu;
+
+	if ( (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_DATATX) ||
+		 (i2cHdlrInst[devIdx].fsmsts == I2C_HDLR_DATARX) )
+	{
+		I2cHdlrIrqComplete(devIdx, I2C_HDLR_ERR);
+	}
+}
+
+static void I2cHdlrDmaInit (tI2cHdlrModIdx devIdx, DMA_HandleTypeDef *hdma, const tI2cHdlrDmaCfg *cfg, uint32_t direction)
+{
+	hdma->Instance = cfg->stream;
+	hdma->Init.Channel = cfg->channel;
+	hdma->Init.Direction = direction;
+	hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma->Init.MemInc = DMA_MINC_ENABLE;
+	hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma->Init.Mode = DMA_NORMAL;
+	hdma->Init.Priority = DMA_PRIORITY_HIGH;
+	hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+	hdma->Parent = &i2cHdlrInst[devIdx];
+
+	if (HAL_DMA_Init(hdma) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	HAL_NVIC_SetPriority(cfg->irqNum, I2C_HDLR_DMA_IRQ_PRIO, 0u);
+	HAL_NVIC_EnableIRQ(cfg->irqNum);
+}
+
+static void I2cHdlrDmaTxCplt (DMA_HandleTypeDef *hdma)
+{
+	tI2cHdlrInstance *inst = (tI2cHdlrInstance *)hdma->Parent;
+
+	/* All bytes are in the data register, the BTF event generates the stop */
+	I2cHdlrDisableDma(inst->regMap);
+	inst->currTr.currPos = inst->currTr.length;
+}
+
+static void I2cHdlrDmaRxCplt (DMA_HandleTypeDef *hdma)
+{
+	tI2cHdlrInstance *inst = (tI2cHdlrInstance *)hdma->Parent;
+
+	I2cHdlrSendStop(inst->regMap);
+	inst->currTr.currPos = inst->currTr.length;
+	I2cHdlrIrqComplete(inst - i2cHdlrInst, I2C_HDLR_OK);
+}
+
+void I2cHdlrDmaTxIrqHandler (tI2cHdlrModIdx devIdx)
+{
+	HAL_DMA_IRQHandler(&i2cHdlrInst[devIdx].dmaTx);
+}
+
+void I2cHdlrDmaRxIrqHandler (tI2cHdlrModIdx devIdx)
+{
+	HAL_DMA_IRQHandler(&i2cHdlrInst[devIdx].dmaRx);
+}
@@ -0,0 +1,37 @@
+/**
+  ******************************************************************************
+  * @file           : I2cHdlrCfg.c
+  * @brief          : I2c Handler board configuration
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#include "main.h"
+
+const tI2cHdlrBusCfg i2cHdlrBusCfg[I2C_HDLR_MOD_NUM] =
+{
+	/* I2C1: encoders and amplifier zone B, PB6 SCL, PB7 SDA */
+	{ TRUE, GPIOB, GPIO_PIN_6, GPIOB, GPIO_PIN_7, GPIO_AF4_I2C1, I2C_HDLR_SPEED_400K, I2C_HDLR_BACKEND_DMA },
+	/* I2C2: amplifier zone A, PB10 SCL, PC12 SDA */
+	{ TRUE, GPIOB, GPIO_PIN_10, GPIOC, GPIO_PIN_12, GPIO_AF4_I2C2, I2C_HDLR_SPEED_100K, I2C_HDLR_BACKEND_DMA },
+	/*
+	 * I2C3: expansion, amplifier zone C, PA8 SCL, PC9 SDA. No device and no
+	 * pull-ups are fitted, the lines would float: enabled only with the
+	 * simulated slave of the host build, enable it with the device and its
+	 * external pull-ups.
+	 */
+#ifdef I2C_HDLR_SIM
+	{ TRUE, GPIOA, GPIO_PIN_8, GPIOC, GPIO_PIN_9, GPIO_AF4_I2C3, I2C_HDLR_SPEED_100K, I2C_HDLR_BACKEND_DMA },
+#else
+	{ FALSE, GPIOA, GPIO_PIN_8, GPIOC, GPIO_PIN_9, GPIO_AF4_I2C3, I2C_HDLR_SPEED_100K, I2C_HDLR_BACKEND_DMA },
+#endif
+};
@@ -0,0 +1,306 @@
+/**
+  ******************************************************************************
+  * @file           : I2cSim.c
+  * @brief          : I2c peripheral model
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Behavioural model of the F4 I2C master sequencing (CR1/SR1/SR2/DR) in a RAM
+ * register block, with a 256 byte auto-incrementing memory device behind it.
+ * Built with I2C_HDLR_SIM defined, it takes I2C_SIM_BUS away from the hardware
+ * so the polled driver can be measured without the devices attached.
+ * Test/ builds the driver with it on the host, 'make' there runs the checks.
+ *
+ * The model is stepped once per superloop pass, before I2cHdlrRun(). Register
+ * reads have no side effect on RAM, so read-cleared flags (ADDR, RXNE) are
+ * consumed on the step after they became visible, the pass in which the
+ * polled driver acts on them. Driver writes to DR are detected through a
+ * sentinel value the model leaves in DR.
+ */
+
+#include <string.h>
+#include "main.h"
+
+#ifdef I2C_HDLR_SIM
+
+#define I2C_SIM_CR1_START	0x0100u
+#define I2C_SIM_CR1_STOP	0x0200u
+#define I2C_SIM_CR1_ACK		0x0400u
+#define I2C_SIM_SR1_SB		0x0001u
+#define I2C_SIM_SR1_ADDR	0x0002u
+#define I2C_SIM_SR1_BTF		0x0004u
+#define I2C_SIM_SR1_RXNE	0x0040u
+#define I2C_SIM_SR1_TXE		0x0080u
+#define I2C_SIM_SR1_AF		0x0400u
+#define I2C_SIM_SR2_MSL		0x0001u
+#define I2C_SIM_SR2_BUSY	0x0002u
+#define I2C_SIM_SR2_TRA		0x0004u
+/* Never written by the driver, DR only carries bytes */
+#define I2C_SIM_DR_EMPTY	0xFFFFu
+
+typedef enum
+{
+	I2C_SIM_IDLE = 0,
+	I2C_SIM_START,
+	I2C_SIM_ADDR,
+	I2C_SIM_TX,
+	I2C_SIM_RX,
+	I2C_SIM_RX_LAST,
+	I2C_SIM_NACKED
+} tI2cSimFsmSts;
+
+static tI2cSimFsmSts fsmsts = I2C_SIM_IDLE;
+static I2C_TypeDef simRegs;
+static uint8_t simMem[256];
+static uint8_t simPtr;
+static boolean simIsPtrSet;
+static boolean simIsRead;
+static uint32_t simByteCnt;
+/* Clock stretching: steps before each flag shows up */
+static uint32_t simStretch;
+static uint32_t simDelay;
+static uint32_t simPendSr1;
+/* One shot faults */
+static boolean simAddrNack;
+static uint32_t simDataNackByte;
+
+static void I2cSimPost (uint32_t sr1)
+{
+	if (simStretch == 0u)
+	{
+		simRegs.SR1 |= sr1;
+	}
+	else
+	{
+		simPendSr1 = sr1;
+		simDelay = simStretch;
+	}
+}
+
+static void I2cSimStop (void)
+{
+	/* A start already requested goes out after the stop */
+	simRegs.CR1 &= ~I2C_SIM_CR1_STOP;
+	simRegs.SR1 = 0u;
+	simRegs.SR2 = 0u;
+	simRegs.DR = I2C_SIM_DR_EMPTY;
+	fsmsts = I2C_SIM_IDLE;
+}
+
+static void I2cSimNextRxByte (void)
+{
+	simRegs.DR = simMem[simPtr];
+	simPtr++;
+	/* The byte shifted in while ACK is clear is Nacked, it is the last one */
+	if ((simRegs.CR1 & I2C_SIM_CR1_ACK) == 0u)
+	{
+		fsmsts = I2C_SIM_RX_LAST;
+	}
+	else
+	{
+		fsmsts = I2C_SIM_RX;
+	}
+	I2cSimPost(I2C_SIM_SR1_RXNE);
+}
+
+void I2cSimInit (void)
+{
+	uint32_t idx;
+
+	memset(&simRegs, 0, sizeof(simRegs));
+	simRegs.DR = I2C_SIM_DR_EMPTY;
+	for (idx = 0u; idx < sizeof(simMem); idx++)
+	{
+		simMem[idx] = (uint8_t)idx;
+	}
+	simPtr = 0u;
+	simStretch = 0u;
+	simDelay = 0u;
+	simPendSr1 = 0u;
+	simAddrNack = FALSE;
+	simDataNackByte = 0u;
+	fsmsts = I2C_SIM_IDLE;
+
+	I2cHdlrSimAttach(I2C_SIM_BUS, &simRegs);
+	PRINT_DEBUG("[I2cSim]: Bus 3 simulated\r\n");
+}
+
+void I2cSimSetStretch (uint32_t steps)
+{
+	simStretch = steps;
+}
+
+/* Nacks the next addressing, or the dataByte-th written byte (1 based, 0 for none) */
+void I2cSimInjectNack (boolean isAddrNack, uint32_t dataByte)
+{
+	simAddrNack = isAddrNack;
+	simDataNackByte = dataByte;
+}
+
+void I2cSimRun (void)
+{
+	uint32_t byte;
+
+	if (simDelay != 0u)
+	{
+		simDelay--;
+		if (simDelay == 0u)
+		{
+			simRegs.SR1 |= simPendSr1;
+			simPendSr1 = 0u;
+		}
+	}
+	else
+	{
+		switch (fsmsts)
+		{
+			case I2C_SIM_IDLE:
+				if ((simRegs.CR1 & I2C_SIM_CR1_START) != 0u)
+				{
+					simRegs.CR1 &= ~I2C_SIM_CR1_START;
+					simRegs.SR2 = I2C_SIM_SR2_MSL | I2C_SIM_SR2_BUSY;
+					simRegs.DR = I2C_SIM_DR_EMPTY;
+					fsmsts = I2C_SIM_START;
+					I2cSimPost(I2C_SIM_SR1_SB);
+				}
+				else if ((simRegs.CR1 & I2C_SIM_CR1_STOP) != 0u)
+				{
+					I2cSimStop();
+				}
+				break;
+
+			case I2C_SIM_START:
+				if (simRegs.DR != I2C_SIM_DR_EMPTY)
+				{
+					/* Writing the address clears SB */
+					byte = simRegs.DR;
+					simRegs.DR = I2C_SIM_DR_EMPTY;
+					simRegs.SR1 &= ~I2C_SIM_SR1_SB;
+
+					if ( ((byte & 0xFEu) != I2C_SIM_DEV_ADDR) || (simAddrNack == TRUE) )
+					{
+						simAddrNack = FALSE;
+						fsmsts = I2C_SIM_NACKED;
+						I2cSimPost(I2C_SIM_SR1_AF);
+					}
+					else if ((byte & 0x01u) != 0u)
+					{
+						simIsRead = TRUE;
+						fsmsts = I2C_SIM_ADDR;
+						I2cSimPost(I2C_SIM_SR1_ADDR);
+					}
+					else
+					{
+						simIsRead = FALSE;
+						simIsPtrSet = FALSE;
+						simByteCnt = 0u;
+						simRegs.SR2 |= I2C_SIM_SR2_TRA;
+						fsmsts = I2C_SIM_ADDR;
+						I2cSimPost(I2C_SIM_SR1_ADDR | I2C_SIM_SR1_TXE);
+					}
+				}
+				break;
+
+			case I2C_SIM_ADDR:
+				/* SR1 then SR2 read by the driver on the previous pass */
+				simRegs.SR1 &= ~I2C_SIM_SR1_ADDR;
+				if (simIsRead == TRUE)
+				{
+					simRegs.SR2 &= ~I2C_SIM_SR2_TRA;
+					I2cSimNextRxByte();
+				}
+				else
+				{
+					fsmsts = I2C_SIM_TX;
+				}
+				break;
+
+			case I2C_SIM_TX:
+				if ((simRegs.CR1 & I2C_SIM_CR1_STOP) != 0u)
+				{
+					I2cSimStop();
+				}
+				else if ((simRegs.CR1 & I2C_SIM_CR1_START) != 0u)
+				{
+					/* Repeated start */
+					simRegs.CR1 &= ~I2C_SIM_CR1_START;
+					simRegs.SR1 &= ~(I2C_SIM_SR1_TXE | I2C_SIM_SR1_BTF);
+					simRegs.DR = I2C_SIM_DR_EMPTY;
+					fsmsts = I2C_SIM_START;
+					I2cSimPost(I2C_SIM_SR1_SB);
+				}
+				else if (simRegs.DR != I2C_SIM_DR_EMPTY)
+				{
+					byte = simRegs.DR;
+					simRegs.DR = I2C_SIM_DR_EMPTY;
+					simRegs.SR1 &= ~(I2C_SIM_SR1_TXE | I2C_SIM_SR1_BTF);
+					simByteCnt++;
+
+					/* First byte is the memory pointer, the others are stored */
+					if (simIsPtrSet == FALSE)
+					{
+						simPtr = (uint8_t)byte;
+						simIsPtrSet = TRUE;
+					}
+					else
+					{
+						simMem[simPtr] = (uint8_t)byte;
+						simPtr++;
+					}
+
+					if (simByteCnt == simDataNackByte)
+					{
+						simDataNackByte = 0u;
+						fsmsts = I2C_SIM_NACKED;
+						I2cSimPost(I2C_SIM_SR1_AF);
+					}
+					else
+					{
+						I2cSimPost(I2C_SIM_SR1_TXE | I2C_SIM_SR1_BTF);
+					}
+				}
+				break;
+
+			case I2C_SIM_RX:
+				if ((simRegs.SR1 & I2C_SIM_SR1_RXNE) != 0u)
+				{
+					/* DR read by the driver on the previous pass */
+					simRegs.SR1 &= ~I2C_SIM_SR1_RXNE;
+					I2cSimNextRxByte();
+				}
+				break;
+
+			case I2C_SIM_RX_LAST:
+				if ((simRegs.SR1 & I2C_SIM_SR1_RXNE) != 0u)
+				{
+					simRegs.SR1 &= ~I2C_SIM_SR1_RXNE;
+				}
+				else if ((simRegs.CR1 & I2C_SIM_CR1_STOP) != 0u)
+				{
+					I2cSimStop();
+				}
+				break;
+
+			case I2C_SIM_NACKED:
+				/* Driver releases the bus with a stop */
+				if ((simRegs.CR1 & I2C_SIM_CR1_STOP) != 0u)
+				{
+					I2cSimStop();
+				}
+				break;
+		}
+	}
+}
+
+#endif
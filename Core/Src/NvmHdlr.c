@@ -0,0 +1,379 @@
+/**
+  ******************************************************************************
+  * @file           : NvmHdlr.c
+  * @brief          : Persistent settings handler
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Record log in flash sectors 1 and 2 (16 KB each), kept out of the FLASH
+ * region by the linker script. Every change appends a key/value record at
+ * the first free slot of the active sector, the newest record of a key wins.
+ * Slot 0 holds the sector generation, the valid sector with the newest one
+ * is the active one.
+ *
+ * Once the active sector runs short of slots, the live values are written to
+ * the spare sector and its generation last: a reset at any point leaves one
+ * complete sector. The old sector then becomes the spare and is erased ahead
+ * of its next use. A value is written once it has been left alone for
+ * NVM_STABLE_MS, a knob being turned costs nothing.
+ *
+ * The core stalls while the flash is erased or programmed (up to 0.5 s for a
+ * 16 KB sector), so both the erase and the compaction wait for idle buses and
+ * an idle or shut down amplifier.
+ */
+
+#include <stdio.h>
+#include "main.h"
+
+#define NVM_SECTOR_NUM 2u
+#define NVM_SECTOR_SIZE 0x4000u
+/* Header word then value word */
+#define NVM_REC_SIZE 8u
+#define NVM_REC_NUM (NVM_SECTOR_SIZE / NVM_REC_SIZE)
+/* Slot 0, key of the generation record */
+#define NVM_GEN_KEY 0xFEu
+/* Below this many free slots the live values move to the spare sector */
+#define NVM_REC_RESERVE 256u
+#define NVM_STABLE_MS 5000u
+/* Next erase after a failed one */
+#define NVM_RETRY_MS 60000u
+#define NVM_ERASED 0xFFFFFFFFu
+#define NVM_CHECK_SEED 0x5AA5u
+#define NVM_FLASH_FLAGS (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | \
+						 FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+typedef struct
+{
+	/* Newest record found or written */
+	boolean isStored;
+	uint32_t stored;
+	/* Newest value set, written once stable */
+	boolean isDirty;
+	uint32_t value;
+	int stableTmr;
+} tNvmHdlrItem;
+
+static const uint32_t nvmSectorBase[NVM_SECTOR_NUM] = {0x08004000u, 0x08008000u};
+static const uint32_t nvmSectorId[NVM_SECTOR_NUM] = {FLASH_SECTOR_1, FLASH_SECTOR_2};
+
+static tNvmHdlrItem nvmItem[NVM_HDLR_KEY_NUM];
+static uint32_t nvmActive;
+static uint32_t nvmGen;
+/* First free slot of the active sector, NVM_REC_NUM once full */
+static uint32_t nvmNext;
+static boolean nvmIsSpareErased = FALSE;
+static tNvmHdlrStats nvmStats;
+static int nvmRetryTmr;
+static char debugLocalStr[64];
+
+/* Key, its complement and a check of the value: an erased or half written slot never matches */
+static uint32_t NvmHdlrHeader (uint32_t key, uint32_t value)
+{
+	uint32_t check = (value ^ (value >> 16) ^ NVM_CHECK_SEED) & 0xFFFFu;
+
+	return (check << 16) | ((~key & 0xFFu) << 8) | key;
+}
+
+static const volatile uint32_t *NvmHdlrSlot (uint32_t sector, uint32_t slot)
+{
+	return (const volatile uint32_t *)(uintptr_t)(nvmSectorBase[sector] + (slot * NVM_REC_SIZE));
+}
+
+/* Generation of a sector, FALSE when slot 0 does not hold a valid one */
+static boolean NvmHdlrGetGen (uint32_t sector, uint32_t *gen)
+{
+	boolean result = FALSE;
+	const volatile uint32_t *slot = NvmHdlrSlot(sector, 0u);
+
+	if (slot[0] == NvmHdlrHeader(NVM_GEN_KEY, slot[1]))
+	{
+		*gen = slot[1];
+		result = TRUE;
+	}
+
+	return result;
+}
+
+static boolean NvmHdlrIsErased (uint32_t sector)
+{
+	boolean result = TRUE;
+	const volatile uint32_t *word = NvmHdlrSlot(sector, 0u);
+	uint32_t idx;
+
+	for (idx = 0u; idx < (NVM_SECTOR_SIZE / 4u); idx++)
+	{
+		if (word[idx] != NVM_ERASED)
+		{
+			result = FALSE;
+		}
+	}
+
+	return result;
+}
+
+static boolean NvmHdlrIsBusIdle (void)
+{
+	boolean result = TRUE;
+	uint32_t idx;
+
+	for (idx = 0u; idx < I2C_HDLR_MOD_NUM; idx++)
+	{
+		if ( (i2cHdlrBusCfg[idx].isEnabled == TRUE) && (I2cHdlrIsFsmBusy((tI2cHdlrModIdx)idx) == TRUE) )
+		{
+			result = FALSE;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Value first, the header commits the record: a reset in between leaves a
+ * slot that is skipped. Read back to catch a slot that was not erased.
+ */
+static NvmHdlrErrCode NvmHdlrProgram (uint32_t sector, uint32_t slot, uint32_t key, uint32_t value)
+{
+	NvmHdlrErrCode result = NVM_HDLR_ERR;
+	const volatile uint32_t *word = NvmHdlrSlot(sector, slot);
+	uint32_t header = NvmHdlrHeader(key, value);
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(NVM_FLASH_FLAGS);
+	if ( (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)(uintptr_t)&word[1], value) == HAL_OK) &&
+		 (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, (uint32_t)(uintptr_t)&word[0], header) == HAL_OK) &&
+		 (word[1] == value) && (word[0] == header) )
+	{
+		result = NVM_HDLR_OK;
+	}
+	else
+	{
+		nvmStats.errCnt++;
+	}
+	HAL_FLASH_Lock();
+
+	return result;
+}
+
+/*
+ * The slot is used whatever happens, a failure marks the sector full. The
+ * value then stays dirty and is appended again once the compaction has moved
+ * the stored ones to the spare sector.
+ */
+static NvmHdlrErrCode NvmHdlrAppend (uint32_t key, uint32_t value)
+{
+	NvmHdlrErrCode result = NvmHdlrProgram(nvmActive, nvmNext, key, value);
+
+	if (result == NVM_HDLR_OK)
+	{
+		nvmItem[key].isStored = TRUE;
+		nvmItem[key].stored = value;
+		nvmStats.appendCnt++;
+		nvmNext++;
+	}
+	else
+	{
+		nvmNext = NVM_REC_NUM;
+	}
+
+	return result;
+}
+
+static void NvmHdlrEraseSpare (void)
+{
+	FLASH_EraseInitTypeDef erase = {0};
+	uint32_t sectorError = 0u;
+
+	erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase.Sector = nvmSectorId[nvmActive ^ 1u];
+	erase.NbSectors = 1u;
+	erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(NVM_FLASH_FLAGS);
+	if (HAL_FLASHEx_Erase(&erase, &sectorError) == HAL_OK)
+	{
+		nvmIsSpareErased = TRUE;
+	}
+	else
+	{
+		nvmStats.errCnt++;
+		TimerSet(&nvmRetryTmr, (int)NVM_RETRY_MS);
+	}
+	HAL_FLASH_Lock();
+}
+
+/* Stored values into the erased spare, its generation last, then it takes over */
+static void NvmHdlrCompact (void)
+{
+	uint32_t spare = nvmActive ^ 1u;
+	uint32_t slot = 1u;
+	boolean isOk = TRUE;
+	uint32_t key;
+
+	nvmIsSpareErased = FALSE;
+	for (key = 0u; key < NVM_HDLR_KEY_NUM; key++)
+	{
+		if ( (isOk == TRUE) && (nvmItem[key].isStored == TRUE) )
+		{
+			isOk = (NvmHdlrProgram(spare, slot, key, nvmItem[key].stored) == NVM_HDLR_OK) ? TRUE : FALSE;
+			slot++;
+		}
+	}
+	if ( (isOk == TRUE) && (NvmHdlrProgram(spare, 0u, NVM_GEN_KEY, nvmGen + 1u) == NVM_HDLR_OK) )
+	{
+		nvmActive = spare;
+		nvmGen++;
+		nvmNext = slot;
+		nvmStats.compactCnt++;
+		sprintf(debugLocalStr, "[Nvm]: Sector %u active, %u records\r\n",
+				(unsigned int)(nvmActive + 1u), (unsigned int)nvmNext);
+		PRINT_DEBUG(debugLocalStr);
+	}
+	else
+	{
+		/* The spare gets erased again, the active sector stays as it is */
+		TimerSet(&nvmRetryTmr, (int)NVM_RETRY_MS);
+	}
+}
+
+/*
+ * Active sector: the valid generation, the newest of the two. Without any,
+ * the store starts empty and full so that the first compaction writes a
+ * generation. Then the newest valid record of every key, the free space
+ * starts at the first erased slot.
+ */
+void NvmHdlrInit (void)
+{
+	const volatile uint32_t *slot;
+	boolean isValid[NVM_SECTOR_NUM];
+	uint32_t gen[NVM_SECTOR_NUM];
+	uint32_t key;
+
+	for (key = 0u; key < NVM_HDLR_KEY_NUM; key++)
+	{
+		nvmItem[key].isStored = FALSE;
+		nvmItem[key].isDirty = FALSE;
+	}
+	isValid[0] = NvmHdlrGetGen(0u, &gen[0]);
+	isValid[1] = NvmHdlrGetGen(1u, &gen[1]);
+	if ( (isValid[0] == TRUE) && (isValid[1] == TRUE) )
+	{
+		nvmActive = ((int32_t)(gen[1] - gen[0]) > 0) ? 1u : 0u;
+	}
+	else
+	{
+		nvmActive = (isValid[0] == TRUE) ? 0u : 1u;
+	}
+
+	if (isValid[nvmActive] == TRUE)
+	{
+		nvmGen = gen[nvmActive];
+		for (nvmNext = 1u; nvmNext < NVM_REC_NUM; nvmNext++)
+		{
+			slot = NvmHdlrSlot(nvmActive, nvmNext);
+			key = slot[0] & 0xFFu;
+			if ( (slot[0] == NVM_ERASED) && (slot[1] == NVM_ERASED) )
+			{
+				break;
+			}
+			if ( (key < NVM_HDLR_KEY_NUM) && (slot[0] == NvmHdlrHeader(key, slot[1])) )
+			{
+				nvmItem[key].isStored = TRUE;
+				nvmItem[key].stored = slot[1];
+				nvmItem[key].value = slot[1];
+			}
+		}
+	}
+	else
+	{
+		nvmGen = 0u;
+		nvmNext = NVM_REC_NUM;
+	}
+	nvmIsSpareErased = NvmHdlrIsErased(nvmActive ^ 1u);
+}
+
+void NvmHdlrRun (void)
+{
+	boolean isQuiet = ( (AmpHdlrIsIdle() == TRUE) && isTimerExpired(nvmRetryTmr) &&
+						(NvmHdlrIsBusIdle() == TRUE) ) ? TRUE : FALSE;
+	uint32_t key;
+
+	/* The spare is kept erased, the erase is the long stall */
+	if ( (nvmIsSpareErased != TRUE) && (isQuiet == TRUE) )
+	{
+		NvmHdlrEraseSpare();
+	}
+	else if ( ((NVM_REC_NUM - nvmNext) < NVM_REC_RESERVE) && (nvmIsSpareErased == TRUE) && (isQuiet == TRUE) )
+	{
+		NvmHdlrCompact();
+	}
+
+	/* Without room the records wait for the compaction */
+	for (key = 0u; key < NVM_HDLR_KEY_NUM; key++)
+	{
+		if ( (nvmItem[key].isDirty == TRUE) && isTimerExpired(nvmItem[key].stableTmr) && (nvmNext < NVM_REC_NUM) )
+		{
+			if (NvmHdlrAppend(key, nvmItem[key].value) == NVM_HDLR_OK)
+			{
+				nvmItem[key].isDirty = FALSE;
+			}
+		}
+	}
+}
+
+NvmHdlrErrCode NvmHdlrGet (tNvmHdlrKey key, uint32_t *value)
+{
+	NvmHdlrErrCode result = NVM_HDLR_ERR;
+
+	if (key < NVM_HDLR_KEY_NUM)
+	{
+		result = NVM_HDLR_NODATA;
+		if (nvmItem[key].isStored == TRUE)
+		{
+			*value = nvmItem[key].stored;
+			result = NVM_HDLR_OK;
+		}
+	}
+
+	return result;
+}
+
+/* Every new value restarts the wait, the one already stored cancels it */
+NvmHdlrErrCode NvmHdlrSet (tNvmHdlrKey key, uint32_t value)
+{
+	NvmHdlrErrCode result = NVM_HDLR_ERR;
+
+	if (key < NVM_HDLR_KEY_NUM)
+	{
+		if ( (nvmItem[key].isStored == TRUE) && (nvmItem[key].stored == value) )
+		{
+			nvmItem[key].isDirty = FALSE;
+		}
+		else if ( (nvmItem[key].isDirty != TRUE) || (nvmItem[key].value != value) )
+		{
+			nvmItem[key].isDirty = TRUE;
+			TimerSet(&nvmItem[key].stableTmr, (int)NVM_STABLE_MS);
+		}
+		nvmItem[key].value = value;
+		result = NVM_HDLR_OK;
+	}
+
+	return result;
+}
+
+void NvmHdlrGetStats (tNvmHdlrStats *stats)
+{
+	*stats = nvmStats;
+	stats->used = nvmNext;
+	stats->free = NVM_REC_NUM - nvmNext;
+}
@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file           : PwrHdlr.c
+  * @brief          : Power save handler
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Last step of the superloop. While the amplifier is shut down the core waits
+ * for an interrupt (sleep mode, clocks and peripherals running) whenever no
+ * bus transfer or debug output needs the polling. The encoder INT wakes it at
+ * once, SysTick bounds every wait to 1 ms so the Timer.c deadlines still run.
+ */
+
+#include <string.h>
+#include "main.h"
+
+static tPwrHdlrState pwrState = PWR_HDLR_ACTIVE;
+static uint32_t pwrStateStamp;
+static uint32_t pwrAwakeStamp;
+static tPwrHdlrStats pwrStats;
+
+static boolean PwrHdlrIsIdle (void)
+{
+	boolean result = TRUE;
+	uint32_t idx;
+
+	for (idx = 0u; idx < I2C_HDLR_MOD_NUM; idx++)
+	{
+		if ( (i2cHdlrBusCfg[idx].isEnabled == TRUE) && (I2cHdlrIsFsmBusy((tI2cHdlrModIdx)idx) == TRUE) )
+		{
+			result = FALSE;
+		}
+	}
+	/* Polled Uart, one byte per wake up otherwise */
+	if (UartDebugHdlrIsTxBusy() == TRUE)
+	{
+		result = FALSE;
+	}
+
+	return result;
+}
+
+void PwrHdlrInit (void)
+{
+	pwrState = PWR_HDLR_ACTIVE;
+	pwrStateStamp = HAL_GetTick();
+}
+
+void PwrHdlrRun (void)
+{
+	uint32_t now = HAL_GetTick();
+	tPwrHdlrState state = (AmpHdlrIsAsleep() == TRUE) ? PWR_HDLR_STANDBY : PWR_HDLR_ACTIVE;
+
+	pwrStats.stateMs[pwrState] += now - pwrStateStamp;
+	pwrStateStamp = now;
+
+	if (state == PWR_HDLR_STANDBY)
+	{
+		/* Both stamps taken awake, no wait in between */
+		if (pwrState == PWR_HDLR_STANDBY)
+		{
+			pwrStats.awakeCycles += DWT->CYCCNT - pwrAwakeStamp;
+		}
+		if (PwrHdlrIsIdle() == TRUE)
+		{
+			__WFI();
+			pwrStats.sleepCnt++;
+		}
+		pwrAwakeStamp = DWT->CYCCNT;
+	}
+	pwrState = state;
+}
+
+/* stamp: CYCCNT of the event that ended the standby */
+void PwrHdlrWakeDone (uint32_t stamp)
+{
+	uint32_t latency = DWT->CYCCNT - stamp;
+
+	pwrStats.wakeCnt++;
+	if (latency > pwrStats.wakeLatencyMax)
+	{
+		pwrStats.wakeLatencyMax = latency;
+	}
+}
+
+void PwrHdlrGetStats (tPwrHdlrStats *stats, boolean isClear)
+{
+	*stats = pwrStats;
+	if (isClear == TRUE)
+	{
+		memset(&pwrStats, 0, sizeof(pwrStats));
+	}
+}
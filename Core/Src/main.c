@@ -84,10 +84,17 @@ int main(void)
   MX_USART2_UART_Init();
   MX_TIM1_Init();
   I2cHdlrInit();
-  EncHdlrInit();
+#ifdef I2C_HDLR_SIM
+  I2cSimInit();
+#endif
+  I2cBenchInit();
+  DevHdlrInit();
+  NvmHdlrInit();
   AmpHdlrInit();
+  EncHdlrInit();
   DebugHdlrInit();
   UartDebugHdlrInit(&huart2);
+  PwrHdlrInit();
 
   //AmpHdlrInit();
   /* USER CODE BEGIN SysInit */
@@ -104,11 +111,18 @@ int main(void)
   while (1)
   {
     /* USER CODE END WHILE */
+#ifdef I2C_HDLR_SIM
+	 I2cSimRun();
+#endif
 	 I2cHdlrRun();
+	 I2cBenchRun();
+	 DevHdlrRun();
 	 EncHdlrRun();
 	 UartDebugHdlrRun();
 	 DebugHdlrRun();
 	 AmpHdlrRun();
+	 NvmHdlrRun();
+	 PwrHdlrRun();
 
 	 /* USER CODE BEGIN 3 */
   }
@@ -0,0 +1,24 @@
+/**
+  ******************************************************************************
+  * @file           : HostHal.h
+  * @brief          : Host stand-ins for the target hardware header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+int HostHalInit(void);
+void HostHalTick(uint32_t ticks);
+void HostHalFlashFail(uint32_t programs);
+#endif
@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file           : core_cm4.h
+  * @brief          : Host build of the Cortex-M4 core header
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Found before the CMSIS one by the host build. The core registers are kept
+ * from the CMSIS header, the intrinsics of cmsis_gcc.h (ARM instructions) are
+ * replaced: barriers do nothing and PRIMASK is a variable.
+ */
+
+#ifndef HOST_CORE_CM4_H
+#define HOST_CORE_CM4_H
+
+#include <stdint.h>
+
+/* cmsis_gcc.h is skipped */
+#define __CMSIS_GCC_H
+
+#define __ASM                  __asm
+#define __INLINE               inline
+#define __STATIC_INLINE        static inline
+#define __STATIC_FORCEINLINE   __attribute__((always_inline)) static inline
+#define __NO_RETURN            __attribute__((__noreturn__))
+#define __USED                 __attribute__((used))
+#define __WEAK                 __attribute__((weak))
+#define __PACKED               __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT        struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION         union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)           __attribute__((aligned(x)))
+#define __RESTRICT             __restrict
+#define __COMPILER_BARRIER()   __asm volatile("" ::: "memory")
+
+#define __NOP()                __COMPILER_BARRIER()
+#define __DSB()                __COMPILER_BARRIER()
+#define __ISB()                __COMPILER_BARRIER()
+#define __DMB()                __COMPILER_BARRIER()
+#define __CLZ(x)               ((uint8_t)(((x) == 0u) ? 32u : (uint32_t)__builtin_clz(x)))
+
+extern uint32_t hostPrimask;
+
+__STATIC_FORCEINLINE void __enable_irq (void)
+{
+	hostPrimask = 0u;
+}
+
+__STATIC_FORCEINLINE void __disable_irq (void)
+{
+	hostPrimask = 1u;
+}
+
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK (void)
+{
+	return hostPrimask;
+}
+
+__STATIC_FORCEINLINE void __set_PRIMASK (uint32_t priMask)
+{
+	hostPrimask = priMask;
+}
+
+/* Next in the search path: the CMSIS one, from a vendor (-isystem) directory */
+#include_next <core_cm4.h>
+
+#endif
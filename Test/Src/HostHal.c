@@ -0,0 +1,230 @@
+/**
+  ******************************************************************************
+  * @file           : HostHal.c
+  * @brief          : Host stand-ins for the target hardware
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * The drivers write the peripheral and core registers at their fixed
+ * addresses, so both ranges are mapped as plain memory: writes are kept,
+ * nothing happens on its own. TIM2->CNT is the Timer.c tick and only moves
+ * with HostHalTick(). The HAL calls made by the drivers under test succeed
+ * without doing anything, the bus that matters runs on the I2cSim model.
+ *
+ * The first flash sectors are plain memory as well, erased at start. A program
+ * clears bits only, as the real cells do, and HostHalFlashFail() makes the
+ * next programs fail without touching the cells.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "main.h"
+#include "HostHal.h"
+
+/* APB1, APB2 and AHB1 peripherals, then the private peripheral bus (NVIC, SCB, DWT) */
+#define HOST_PERIPH_SIZE 0x80000u
+#define HOST_CORE_BASE 0xE0000000u
+#define HOST_CORE_SIZE 0x100000u
+/* Sectors 0 to 3, 16 KB each */
+#define HOST_FLASH_SECTOR_SIZE 0x4000u
+#define HOST_FLASH_SIZE (4u * HOST_FLASH_SECTOR_SIZE)
+
+uint32_t hostPrimask;
+static uint32_t hostFlashFailCnt;
+
+static int HostHalMap (uint32_t base, uint32_t size)
+{
+	int result = 0;
+	void *addr = mmap((void *)(uintptr_t)base, size, PROT_READ | PROT_WRITE,
+					  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (addr != (void *)(uintptr_t)base)
+	{
+		printf("[Host]: Cannot map 0x%08X\n", (unsigned int)base);
+		result = -1;
+	}
+
+	return result;
+}
+
+int HostHalInit (void)
+{
+	int result = HostHalMap(PERIPH_BASE, HOST_PERIPH_SIZE);
+
+	if (result == 0)
+	{
+		result = HostHalMap(HOST_CORE_BASE, HOST_CORE_SIZE);
+	}
+	if (result == 0)
+	{
+		result = HostHalMap(FLASH_BASE, HOST_FLASH_SIZE);
+	}
+	if (result == 0)
+	{
+		memset((void *)(uintptr_t)FLASH_BASE, 0xFF, HOST_FLASH_SIZE);
+	}
+
+	return result;
+}
+
+void HostHalTick (uint32_t ticks)
+{
+	TIM2->CNT += ticks;
+}
+
+void HostHalFlashFail (uint32_t programs)
+{
+	hostFlashFailCnt = programs;
+}
+
+void Error_Handler (void)
+{
+	printf("[Host]: Error_Handler\n");
+	exit(1);
+}
+
+DebugHdlrErrCode DebugHdlrPrintMsg (const char *buff)
+{
+	(void)buff;
+
+	return DEBUG_HDLR_OK;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq (void)
+{
+	/* 180 MHz core, APB1 divided by 4 */
+	return 45000000u;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq (void)
+{
+	return 180000000u;
+}
+
+void HAL_GPIO_Init (GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+	(void)GPIOx;
+	(void)GPIO_Init;
+}
+
+/* Lines released, a bus recovery ends at once */
+GPIO_PinState HAL_GPIO_ReadPin (GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	(void)GPIOx;
+	(void)GPIO_Pin;
+
+	return GPIO_PIN_SET;
+}
+
+void HAL_GPIO_WritePin (GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	(void)GPIOx;
+	(void)GPIO_Pin;
+	(void)PinState;
+}
+
+void HAL_NVIC_SetPriority (IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ (IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ (IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init (DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT (DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+	(void)hdma;
+	(void)SrcAddress;
+	(void)DstAddress;
+	(void)DataLength;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort_IT (DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+
+	return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler (DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock (void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock (void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program (uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	HAL_StatusTypeDef result = HAL_ERROR;
+
+	if ( (TypeProgram == FLASH_TYPEPROGRAM_WORD) && (Address >= FLASH_BASE) &&
+		 (Address < (FLASH_BASE + HOST_FLASH_SIZE)) && (hostFlashFailCnt == 0u) )
+	{
+		*(volatile uint32_t *)(uintptr_t)Address &= (uint32_t)Data;
+		result = HAL_OK;
+	}
+	else if (hostFlashFailCnt != 0u)
+	{
+		hostFlashFailCnt--;
+	}
+
+	return result;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase (FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+	HAL_StatusTypeDef result = HAL_ERROR;
+	uint32_t sector = pEraseInit->Sector;
+
+	*SectorError = 0xFFFFFFFFu;
+	if ( (pEraseInit->NbSectors == 1u) && (sector < (HOST_FLASH_SIZE / HOST_FLASH_SECTOR_SIZE)) )
+	{
+		memset((void *)(uintptr_t)(FLASH_BASE + (sector * HOST_FLASH_SECTOR_SIZE)), 0xFF, HOST_FLASH_SECTOR_SIZE);
+		result = HAL_OK;
+	}
+	else
+	{
+		*SectorError = sector;
+	}
+
+	return result;
+}
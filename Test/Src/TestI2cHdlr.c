@@ -0,0 +1,329 @@
+/**
+  ******************************************************************************
+  * @file           : TestI2cHdlr.c
+  * @brief          : Host test of the polled I2c driver on the I2cSim model
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Runs the superloop pair I2cSimRun()/I2cHdlrRun() on I2C_SIM_BUS and checks
+ * the outcome of a completed write and write-read, a clock stretched one, an
+ * address and a data Nack, a retry that succeeds and the backoff between the
+ * attempts. The Timer.c tick moves once every TEST_PASSES_PER_TICK passes.
+ * Any failed check makes the program, and the make target running it, fail.
+ *
+ * The benchmark repeats the write and the write-read and prints the
+ * I2cHdlrRun() calls and the host time (CLOCK_MONOTONIC) per transaction.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "main.h"
+#include "HostHal.h"
+
+#define TEST_PASSES_PER_TICK 50u
+/* Far more than any transaction of the tests needs */
+#define TEST_PASSES_MAX 100000u
+/* Not answered by the model */
+#define TEST_ABSENT_ADDR 0xA4u
+#define TEST_BENCH_REPEAT 10000u
+/* Steps of the model before each flag, well within I2C_HDLR_STATE_TIMEOUT */
+#define TEST_STRETCH 4u
+
+static uint32_t testPass;
+static uint32_t testFailCnt;
+
+static void TestCheck (int isOk, const char *name)
+{
+	printf("%s: %s\n", (isOk != 0) ? "PASS" : "FAIL", name);
+	if (isOk == 0)
+	{
+		testFailCnt++;
+	}
+}
+
+static void TestStep (void)
+{
+	I2cSimRun();
+	I2cHdlrRun();
+	testPass++;
+	if ((testPass % TEST_PASSES_PER_TICK) == 0u)
+	{
+		HostHalTick(1u);
+	}
+}
+
+/* Superloop passes until the status is final, TEST_PASSES_MAX when it never is */
+static uint32_t TestRun (volatile tI2cHdlrTrStatus *status)
+{
+	uint32_t passes = 0u;
+
+	while ( (*status == I2C_HDLR_TR_PENDING) && (passes < TEST_PASSES_MAX) )
+	{
+		TestStep();
+		passes++;
+	}
+
+	return passes;
+}
+
+static I2cHdlrErrCode TestEnqueue (uint8_t addr, uint8_t *txData, uint16_t txLength, uint8_t *rxData, uint16_t rxLength,
+								   uint8_t retries, volatile tI2cHdlrTrStatus *status)
+{
+	tI2cHdlrTr tr = {0};
+
+	tr.addr = addr;
+	tr.pTxData = txData;
+	tr.txLength = txLength;
+	tr.pRxData = rxData;
+	tr.rxLength = rxLength;
+	tr.retries = retries;
+	tr.pStatus = status;
+
+	return I2cHdlrEnqueue(I2C_SIM_BUS, &tr);
+}
+
+static void TestOk (void)
+{
+	uint8_t txData[] = {0x10u, 0xA5u, 0x5Au, 0x3Cu};
+	uint8_t reg = 0x10u;
+	uint8_t rxData[3] = {0};
+	volatile tI2cHdlrTrStatus status;
+	tI2cHdlrStats stats;
+	uint32_t passes;
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, TRUE);
+	TestCheck(TestEnqueue(I2C_SIM_DEV_ADDR, txData, sizeof(txData), NULL, 0u, 0u, &status) == I2C_HDLR_OK, "write queued");
+	passes = TestRun(&status);
+	TestCheck(status == I2C_HDLR_TR_OK, "write completes OK");
+	printf("  write of %u bytes: %u passes\n", (unsigned int)sizeof(txData), (unsigned int)passes);
+
+	TestCheck(TestEnqueue(I2C_SIM_DEV_ADDR, &reg, 1u, rxData, sizeof(rxData), 0u, &status) == I2C_HDLR_OK, "write-read queued");
+	passes = TestRun(&status);
+	TestCheck(status == I2C_HDLR_TR_OK, "write-read completes OK");
+	TestCheck(memcmp(rxData, &txData[1], sizeof(rxData)) == 0, "write-read returns the written bytes");
+	printf("  write-read of %u bytes: %u passes\n", (unsigned int)sizeof(rxData), (unsigned int)passes);
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, FALSE);
+	TestCheck( (stats.trCnt == 2u) && (stats.errCnt == 0u) && (stats.byteCnt == 8u), "OK transactions counted");
+}
+
+static uint64_t TestNs (void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000u) + (uint64_t)now.tv_nsec;
+}
+
+/* Superloop passes of one transaction, FALSE when it does not complete OK */
+static boolean TestTransfer (uint8_t *txData, uint16_t txLength, uint8_t *rxData, uint16_t rxLength, uint32_t *passes)
+{
+	volatile tI2cHdlrTrStatus status;
+
+	TestEnqueue(I2C_SIM_DEV_ADDR, txData, txLength, rxData, rxLength, 0u, &status);
+	*passes = TestRun(&status);
+
+	return (status == I2C_HDLR_TR_OK) ? TRUE : FALSE;
+}
+
+static void TestBenchOne (const char *name, uint8_t *txData, uint16_t txLength, uint8_t *rxData, uint16_t rxLength)
+{
+	boolean isOk = TRUE;
+	uint32_t calls = 0u;
+	uint32_t passes;
+	uint64_t start = TestNs();
+	uint64_t ns;
+	uint32_t idx;
+
+	for (idx = 0u; idx < TEST_BENCH_REPEAT; idx++)
+	{
+		if (TestTransfer(txData, txLength, rxData, rxLength, &passes) != TRUE)
+		{
+			isOk = FALSE;
+		}
+		calls += passes;
+	}
+	ns = TestNs() - start;
+
+	TestCheck(isOk == TRUE, name);
+	printf("  %s: %u calls, %u ns per transaction\n", name, (unsigned int)(calls / TEST_BENCH_REPEAT),
+		   (unsigned int)(ns / TEST_BENCH_REPEAT));
+}
+
+static void TestBench (void)
+{
+	uint8_t txData[] = {0x50u, 0x11u, 0x22u, 0x33u};
+	uint8_t reg = 0x50u;
+	uint8_t rxData[3] = {0};
+
+	TestBenchOne("bench write of 4 bytes", txData, sizeof(txData), NULL, 0u);
+	TestBenchOne("bench write-read of 3 bytes", &reg, 1u, rxData, sizeof(rxData));
+}
+
+/*
+ * Every flag of the model is held back by the stretch. An addressing posts SB
+ * and ADDR, every byte one more flag, so the passes grow by the stretch times
+ * that count.
+ */
+static void TestStretch (void)
+{
+	uint8_t txData[] = {0x60u, 0x5Au, 0xA5u};
+	uint8_t reg = 0x60u;
+	uint8_t rxData[2] = {0};
+	uint32_t txFlags = 2u + sizeof(txData);
+	uint32_t rxFlags = (2u + 1u) + (2u + sizeof(rxData));
+	uint32_t txPasses[3];
+	uint32_t rxPasses[3];
+	boolean isOk = TRUE;
+	uint32_t idx;
+
+	for (idx = 0u; idx < 3u; idx++)
+	{
+		/* 0, TEST_STRETCH and twice it */
+		I2cSimSetStretch(idx * TEST_STRETCH);
+		if ( (TestTransfer(txData, sizeof(txData), NULL, 0u, &txPasses[idx]) != TRUE) ||
+			 (TestTransfer(&reg, 1u, rxData, sizeof(rxData), &rxPasses[idx]) != TRUE) )
+		{
+			isOk = FALSE;
+		}
+	}
+	I2cSimSetStretch(0u);
+
+	TestCheck(isOk == TRUE, "stretched write and write-read complete OK");
+	TestCheck(memcmp(rxData, &txData[1], sizeof(rxData)) == 0, "stretched write-read returns the written bytes");
+	TestCheck( ((txPasses[1] - txPasses[0]) == (txFlags * TEST_STRETCH)) &&
+			   ((txPasses[2] - txPasses[0]) == (txFlags * 2u * TEST_STRETCH)),
+			   "stretched write passes grow by the stretch per flag");
+	TestCheck( ((rxPasses[1] - rxPasses[0]) == (rxFlags * TEST_STRETCH)) &&
+			   ((rxPasses[2] - rxPasses[0]) == (rxFlags * 2u * TEST_STRETCH)),
+			   "stretched write-read passes grow by the stretch per flag");
+	printf("  write of %u bytes: %u/%u/%u passes at stretch 0/%u/%u\n", (unsigned int)sizeof(txData),
+		   (unsigned int)txPasses[0], (unsigned int)txPasses[1], (unsigned int)txPasses[2],
+		   (unsigned int)TEST_STRETCH, (unsigned int)(2u * TEST_STRETCH));
+	printf("  write-read of %u bytes: %u/%u/%u passes at stretch 0/%u/%u\n", (unsigned int)sizeof(rxData),
+		   (unsigned int)rxPasses[0], (unsigned int)rxPasses[1], (unsigned int)rxPasses[2],
+		   (unsigned int)TEST_STRETCH, (unsigned int)(2u * TEST_STRETCH));
+}
+
+static void TestNack (void)
+{
+	uint8_t txData[] = {0x20u, 0x01u, 0x02u};
+	volatile tI2cHdlrTrStatus status;
+	tI2cHdlrStats stats;
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, TRUE);
+	TestEnqueue(TEST_ABSENT_ADDR, txData, sizeof(txData), NULL, 0u, 0u, &status);
+	TestRun(&status);
+	TestCheck(status == I2C_HDLR_TR_ADDR_NACK, "absent device reports ADDR_NACK");
+	TestCheck(I2cHdlrGetLastStatus(I2C_SIM_BUS) == I2C_HDLR_TR_ADDR_NACK, "last status is ADDR_NACK");
+
+	/* Register address accepted, the first data byte refused */
+	I2cSimInjectNack(FALSE, 2u);
+	TestEnqueue(I2C_SIM_DEV_ADDR, txData, sizeof(txData), NULL, 0u, 0u, &status);
+	TestRun(&status);
+	TestCheck(status == I2C_HDLR_TR_DATA_NACK, "refused data byte reports DATA_NACK");
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, FALSE);
+	TestCheck( (stats.nackCnt == 2u) && (stats.errCnt == 2u) && (stats.retryCnt == 0u), "Nacks counted, no retry");
+	TestCheck(I2cHdlrIsFsmBusy(I2C_SIM_BUS) == FALSE, "bus idle after the Nacks");
+}
+
+static void TestRetry (void)
+{
+	uint8_t txData[] = {0x30u, 0x77u};
+	uint8_t reg = 0x30u;
+	uint8_t rxData = 0u;
+	volatile tI2cHdlrTrStatus status;
+	tI2cHdlrStats stats;
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, TRUE);
+	I2cSimInjectNack(TRUE, 0u);
+	TestEnqueue(I2C_SIM_DEV_ADDR, txData, sizeof(txData), NULL, 0u, I2C_HDLR_RETRIES_DEFAULT, &status);
+	TestRun(&status);
+	TestCheck(status == I2C_HDLR_TR_OK, "one Nack then OK on the retry");
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, FALSE);
+	TestCheck( (stats.retryCnt == 1u) && (stats.nackCnt == 1u) && (stats.trCnt == 1u) && (stats.errCnt == 0u),
+			   "retried once, accounted once as OK");
+
+	TestEnqueue(I2C_SIM_DEV_ADDR, &reg, 1u, &rxData, 1u, 0u, &status);
+	TestRun(&status);
+	TestCheck( (status == I2C_HDLR_TR_OK) && (rxData == txData[1]), "retried write reached the device");
+}
+
+/* Ticks between two attempts: the backoff, plus one as Timer.c expires on the tick after */
+static void TestBackoff (void)
+{
+	uint8_t txData[] = {0x40u, 0x00u};
+	volatile tI2cHdlrTrStatus status;
+	tI2cHdlrStats stats;
+	uint32_t attemptTick[I2C_HDLR_RETRIES_DEFAULT + 1u];
+	uint32_t attempts = 0u;
+	uint32_t passes = 0u;
+	uint32_t gap;
+	uint32_t backoff;
+	uint32_t idx;
+	char name[64];
+
+	I2cHdlrGetStats(I2C_SIM_BUS, &stats, TRUE);
+	TestEnqueue(TEST_ABSENT_ADDR, txData, sizeof(txData), NULL, 0u, I2C_HDLR_RETRIES_DEFAULT, &status);
+	while ( (status == I2C_HDLR_TR_PENDING) && (passes < TEST_PASSES_MAX) )
+	{
+		TestStep();
+		passes++;
+		I2cHdlrGetStats(I2C_SIM_BUS, &stats, FALSE);
+		if ( (stats.nackCnt > attempts) && (attempts <= I2C_HDLR_RETRIES_DEFAULT) )
+		{
+			attemptTick[attempts] = TIM2->CNT;
+			attempts = stats.nackCnt;
+		}
+	}
+
+	TestCheck(status == I2C_HDLR_TR_ADDR_NACK, "retries exhausted, ADDR_NACK");
+	TestCheck( (attempts == (I2C_HDLR_RETRIES_DEFAULT + 1u)) && (stats.retryCnt == I2C_HDLR_RETRIES_DEFAULT) &&
+			   (stats.trCnt == 1u) && (stats.errCnt == 1u), "one attempt plus the retries, accounted once");
+	for (idx = 1u; idx < attempts; idx++)
+	{
+		gap = attemptTick[idx] - attemptTick[idx - 1u];
+		backoff = (uint32_t)I2C_HDLR_RETRY_BACKOFF << (idx - 1u);
+		sprintf(name, "retry %u after %u ticks, backoff %u", (unsigned int)idx, (unsigned int)gap, (unsigned int)backoff);
+		TestCheck(gap == (backoff + 1u), name);
+	}
+}
+
+int main (void)
+{
+	if (HostHalInit() != 0)
+	{
+		return 1;
+	}
+
+	I2cHdlrInit();
+	I2cSimInit();
+	/* INIT to IDLE */
+	TestStep();
+
+	TestOk();
+	TestStretch();
+	TestNack();
+	TestRetry();
+	TestBackoff();
+	TestBench();
+
+	printf("%u failed\n", (unsigned int)testFailCnt);
+
+	return (testFailCnt == 0u) ? 0 : 1;
+}
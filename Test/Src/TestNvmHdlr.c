@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file           : TestNvmHdlr.c
+  * @brief          : Host test of the settings record log
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 EmbeddedEspresso.
+  * All rights reserved.
+  *
+  * This software component is licensed by EmbeddedEspresso under BSD 3-Clause
+  * license. You may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at:
+  * opensource.org/licenses/BSD-3-Clause
+  ******************************************************************************
+  */
+
+/*
+ * Runs NvmHdlrRun() on the flash sectors of HostHal.c, one Timer.c tick per
+ * pass, with the buses and the amplifier idle. Checks the first compaction
+ * of an empty store, an append, and a value whose program fails: it has to
+ * reach the flash after the compaction and be found again by NvmHdlrInit().
+ */
+
+#include <stdio.h>
+#include "main.h"
+#include "HostHal.h"
+
+/* Well over NVM_STABLE_MS */
+#define TEST_STABLE_TICKS 6000u
+
+static uint32_t testFailCnt;
+
+static void TestCheck (int isOk, const char *name)
+{
+	printf("%s: %s\n", (isOk != 0) ? "PASS" : "FAIL", name);
+	if (isOk == 0)
+	{
+		testFailCnt++;
+	}
+}
+
+/* Stands in for the amplifier, never busy */
+boolean AmpHdlrIsIdle (void)
+{
+	return TRUE;
+}
+
+static void TestRun (uint32_t ticks)
+{
+	uint32_t idx;
+
+	for (idx = 0u; idx < ticks; idx++)
+	{
+		HostHalTick(1u);
+		NvmHdlrRun();
+	}
+}
+
+/* Empty flash: the first pass writes a generation, then the value is appended */
+static void TestAppend (void)
+{
+	tNvmHdlrStats stats;
+	uint32_t value = 0u;
+
+	NvmHdlrInit();
+	TestCheck(NvmHdlrGet(NVM_HDLR_KEY_VOLUME, &value) == NVM_HDLR_NODATA, "empty store has no volume");
+	TestRun(1u);
+	NvmHdlrGetStats(&stats);
+	TestCheck( (stats.compactCnt == 1u) && (stats.used == 1u), "empty store gets a generation");
+
+	NvmHdlrSet(NVM_HDLR_KEY_VOLUME, 10u);
+	TestRun(TEST_STABLE_TICKS);
+	NvmHdlrGetStats(&stats);
+	TestCheck( (NvmHdlrGet(NVM_HDLR_KEY_VOLUME, &value) == NVM_HDLR_OK) && (value == 10u), "stable volume stored");
+	TestCheck( (stats.appendCnt == 1u) && (stats.used == 2u) && (stats.errCnt == 0u), "one record appended");
+}
+
+/* The failed slot fills the sector, the compaction runs and the value is appended after it */
+static void TestProgramFail (void)
+{
+	tNvmHdlrStats stats;
+	uint32_t value = 0u;
+
+	NvmHdlrSet(NVM_HDLR_KEY_VOLUME, 20u);
+	HostHalFlashFail(1u);
+	TestRun(TEST_STABLE_TICKS);
+	NvmHdlrGetStats(&stats);
+	TestCheck(stats.errCnt == 1u, "failed program counted");
+	TestCheck(stats.compactCnt == 2u, "failed program moves the records to the spare");
+	TestCheck( (NvmHdlrGet(NVM_HDLR_KEY_VOLUME, &value) == NVM_HDLR_OK) && (value == 20u),
+			   "value of the failed program stored after the compaction");
+
+	/* Reset */
+	NvmHdlrInit();
+	TestCheck( (NvmHdlrGet(NVM_HDLR_KEY_VOLUME, &value) == NVM_HDLR_OK) && (value == 20u),
+			   "value of the failed program found at boot");
+}
+
+int main (void)
+{
+	if (HostHalInit() != 0)
+	{
+		return 1;
+	}
+
+	I2cHdlrInit();
+	/* INIT to IDLE */
+	I2cHdlrRun();
+
+	TestAppend();
+	TestProgramFail();
+
+	printf("%u failed\n", (unsigned int)testFailCnt);
+
+	return (testFailCnt == 0u) ? 0 : 1;
+}